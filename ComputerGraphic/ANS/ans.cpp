@@ -0,0 +1,680 @@
+#include "pch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include "ans.h"
+#include "bitfile.h"
+#include "sink.h"
+
+/*
+* A stream is ANS_MAGIC, the version, the number of states and the block
+* size, then the blocks. A block is its symbol count, its frequency table
+* padded to a byte, the length of its coded bytes and the coded bytes. A
+* symbol count of 0 ends the stream.
+*/
+#define ANS_MAGIC           "ANS"
+#define ANS_VERSION         1
+#define ANS_HEADER_SIZE     9
+
+#define NUM_CHARS           256
+
+/* frequencies of a block are scaled to sum to ANS_SCALE */
+#define ANS_SCALE_BITS      12
+#define ANS_SCALE           (1 << ANS_SCALE_BITS)
+
+/*
+* A state stays in [ANS_LOW, 2^32) between symbols, 16 bit words move out
+* of it and into it. A symbol brings a state down to no less than
+* ANS_LOW >> ANS_SCALE_BITS, so the decoder reads at most one word.
+*/
+#define ANS_LOW             (1u << 16)
+
+#define DEFAULT_STREAMS     4
+#define MAX_STREAMS         8
+
+#define DEFAULT_BLOCK_SIZE  (1 << 16)
+#define MIN_BLOCK_SIZE      (1 << 12)
+#define MAX_BLOCK_SIZE      (1 << 24)
+
+/* bits of a frequency in the table, and the bytes a whole table takes at most */
+#define FREQ_WIDTH_BITS     4
+#define TABLE_BOUND         ((FREQ_WIDTH_BITS + NUM_CHARS * (1 + ANS_SCALE_BITS) + 7) / 8)
+
+/* a symbol costs at most ANS_SCALE_BITS bits, each state ends with its 4 bytes and a partly used word */
+#define CODED_BOUND(n, numStreams)  ((size_t)(n) + (size_t)(n) / 2 + 1 + 8 * (size_t)(numStreams))
+#define BLOCK_BOUND(n, numStreams)  (2 * sizeof(uint32_t) + TABLE_BOUND + CODED_BOUND(n, numStreams))
+
+/*
+* Decode table slot: the symbol in the low byte, its frequency less one and
+* the slot's offset from the symbol's first slot in 12 bits each above it.
+*/
+#define SLOT_SYMBOL(e)      ((e) & 0xFF)
+#define SLOT_FREQ(e)        ((((e) >> 8) & (ANS_SCALE - 1)) + 1)
+#define SLOT_OFFSET(e)      ((e) >> 20)
+
+/* why decoding stopped, AnsDecodeFile reports it on stderr */
+typedef enum
+{
+    DECODE_OK = 0,
+    DECODE_BAD_HEADER,
+    DECODE_BAD_STREAM,
+    DECODE_BAD_VERSION,
+    DECODE_NO_ROOM
+} DECODE_STATUS;
+
+static int CheckOptions(const ans_options_t* options, unsigned int* blockSize, int* numStreams);
+static void WriteSignature(bit_file_t* bfp, unsigned int blockSize, int numStreams);
+static void WriteEnd(bit_file_t* bfp);
+static int EncodeBlock(const unsigned char* symbols, size_t len, int numStreams, bit_file_t* bOutFile,
+    unsigned char* scratch, unsigned char* scratchEnd);
+static void NormalizeFrequencies(const unsigned char* symbols, size_t len, uint32_t* freqs);
+static void WriteFrequencies(const uint32_t* freqs, bit_file_t* bfp);
+static unsigned char* EncodeSymbols(const unsigned char* symbols, size_t len, int numStreams, const uint32_t* freqs,
+    unsigned char* begin, unsigned char* end);
+
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink);
+static int ReadFrequencies(uint32_t* freqs, bit_file_t* bfp);
+static void BuildDecodeTable(uint32_t* table, const uint32_t* freqs);
+static int DecodeSymbols(const uint32_t* table, int numStreams, const unsigned char* coded, size_t codedLen,
+    unsigned char* out, size_t len);
+
+void AnsDefaultOptions(ans_options_t* options)
+{
+    options->blockSize = 0;
+    options->numStreams = 0;
+}
+
+int AnsEncodeFile(FILE* inFile, FILE* outFile, const ans_options_t* options)
+{
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    ans_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        AnsDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    unsigned int blockSize;
+    int numStreams;
+    if(CheckOptions(options, &blockSize, &numStreams) != 0)
+        return -1;
+
+    bit_file_t* bOutFile = MakeBitFile(outFile, BF_WRITE);
+
+    if(nullptr == bOutFile)
+    {
+        perror("Making Output File a BitFile");
+        return -1;
+    }
+
+    /* a block is coded backwards, so it is read whole and coded into scratch before it goes out */
+    size_t scratchSize = CODED_BOUND(blockSize, numStreams);
+    unsigned char* block = new unsigned char[blockSize];
+    unsigned char* scratch = new unsigned char[scratchSize];
+
+    WriteSignature(bOutFile, blockSize, numStreams);
+    size_t len;
+    int status = 0;
+    while((status == 0) && ((len = fread(block, 1, blockSize, inFile)) != 0))
+        status = EncodeBlock(block, len, numStreams, bOutFile, scratch, scratch + scratchSize);
+    WriteEnd(bOutFile);
+
+    delete[] scratch;
+    delete[] block;
+    outFile = BitFileToFILE(bOutFile);
+    return status;
+}
+
+int AnsEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ans_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    ans_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        AnsDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    unsigned int blockSize;
+    int numStreams;
+    if(CheckOptions(options, &blockSize, &numStreams) != 0)
+        return -1;
+
+    bit_file_t bOutFile;
+    InitBitBuffer(&bOutFile, dst, capacity, BF_WRITE);
+
+    WriteSignature(&bOutFile, blockSize, numStreams);
+    for(size_t pos = 0; pos < size; pos += blockSize)
+    {
+        size_t len = (size - pos < blockSize) ? size - pos : blockSize;
+        if(EncodeBlock(src + pos, len, numStreams, &bOutFile, nullptr, dst + capacity) != 0)
+        {
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    WriteEnd(&bOutFile);
+
+    size_t used = CloseBitBuffer(&bOutFile);
+    if(bOutFile.error)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    *dstSize = used;
+    return 0;
+}
+
+size_t AnsEncodeBound(const size_t size, const ans_options_t* options)
+{
+    ans_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        AnsDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    unsigned int blockSize;
+    int numStreams;
+    if(CheckOptions(options, &blockSize, &numStreams) != 0)
+        return 0;
+
+    size_t numBlocks = (size + blockSize - 1) / blockSize;
+    return ANS_HEADER_SIZE + sizeof(uint32_t) + numBlocks * BLOCK_BOUND(0, numStreams) + CODED_BOUND(size, 0);
+}
+
+static int CheckOptions(const ans_options_t* options, unsigned int* blockSize, int* numStreams)
+{
+    *blockSize = (options->blockSize != 0) ? options->blockSize : DEFAULT_BLOCK_SIZE;
+    *numStreams = (options->numStreams != 0) ? (int)options->numStreams : DEFAULT_STREAMS;
+    if((*blockSize < MIN_BLOCK_SIZE) || (*blockSize > MAX_BLOCK_SIZE) || (options->numStreams > MAX_STREAMS))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static void WriteSignature(bit_file_t* bfp, unsigned int blockSize, int numStreams)
+{
+    for(int i = 0; ANS_MAGIC[i] != '\0'; i++)
+        BitFilePutChar(ANS_MAGIC[i], bfp);
+    BitFilePutChar(ANS_VERSION, bfp);
+    BitFilePutChar(numStreams, bfp);
+    BitFilePutBitsNum(bfp, &blockSize, 32, sizeof(blockSize));
+}
+
+static void WriteEnd(bit_file_t* bfp)
+{
+    uint32_t numSymbols = 0;
+    BitFilePutBitsNum(bfp, &numSymbols, 32, sizeof(numSymbols));
+}
+
+/*
+* Codes a block of len symbols. A FILE block is coded into scratch first.
+* For a buffer scratch is nullptr, the block is coded backwards from
+* scratchEnd down to what the bit file has written, then moved down to
+* follow its length. Returns -1 when the coded bytes do not fit.
+*/
+static int EncodeBlock(const unsigned char* symbols, size_t len, int numStreams, bit_file_t* bOutFile,
+    unsigned char* scratch, unsigned char* scratchEnd)
+{
+    uint32_t freqs[NUM_CHARS];
+    NormalizeFrequencies(symbols, len, freqs);
+
+    uint32_t numSymbols = (uint32_t)len;
+    BitFilePutBitsNum(bOutFile, &numSymbols, 32, sizeof(numSymbols));
+    WriteFrequencies(freqs, bOutFile);
+
+    if(scratch != nullptr)
+    {
+        unsigned char* coded = EncodeSymbols(symbols, len, numStreams, freqs, scratch, scratchEnd);
+        if(coded == nullptr)
+            return -1;
+
+        uint32_t codedLen = (uint32_t)(scratchEnd - coded);
+        BitFilePutBitsNum(bOutFile, &codedLen, 32, sizeof(codedLen));
+        BitFilePutBytes(bOutFile, coded, codedLen);
+        return 0;
+    }
+
+    unsigned char* lenField = BitFileBufferBytes(bOutFile, sizeof(uint32_t));
+    unsigned char* begin = BitFileBufferBytes(bOutFile, 0);
+    if((lenField == nullptr) || (begin == nullptr))
+        return -1;
+
+    unsigned char* coded = EncodeSymbols(symbols, len, numStreams, freqs, begin, scratchEnd);
+    if(coded == nullptr)
+        return -1;
+
+    size_t codedLen = scratchEnd - coded;
+    memmove(begin, coded, codedLen);
+    BitFileBufferBytes(bOutFile, codedLen);
+    for(int i = 0; i < 4; i++)
+        lenField[i] = (unsigned char)(codedLen >> (8 * i));
+    return 0;
+}
+
+/*
+* Counts the symbols of a block and scales the counts to sum to ANS_SCALE,
+* every symbol that occurs keeps at least 1. What rounding leaves over or
+* short is settled on the most frequent symbols.
+*/
+static void NormalizeFrequencies(const unsigned char* symbols, size_t len, uint32_t* freqs)
+{
+    uint32_t counts[NUM_CHARS];
+    memset(counts, 0, sizeof(counts));
+    for(size_t i = 0; i < len; i++)
+        counts[symbols[i]]++;
+
+    uint32_t sum = 0;
+    int largest = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        if(counts[c] == 0)
+        {
+            freqs[c] = 0;
+            continue;
+        }
+
+        freqs[c] = (uint32_t)(((uint64_t)counts[c] * ANS_SCALE + len / 2) / len);
+        if(freqs[c] == 0)
+            freqs[c] = 1;
+        sum += freqs[c];
+        if(counts[c] > counts[largest])
+            largest = c;
+    }
+
+    if(sum < ANS_SCALE)
+        freqs[largest] += ANS_SCALE - sum;
+
+    while(sum > ANS_SCALE)
+    {
+        /* only the symbols forced up to 1 can push the sum over, taking one from the largest each time is enough */
+        largest = 0;
+        for(int c = 1; c < NUM_CHARS; c++)
+        {
+            if(freqs[c] > freqs[largest])
+                largest = c;
+        }
+        freqs[largest]--;
+        sum--;
+    }
+}
+
+/* the bits each frequency less one takes, then a presence bit per symbol and the frequency of those present */
+static void WriteFrequencies(const uint32_t* freqs, bit_file_t* bfp)
+{
+    uint32_t maxFreq = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        if(freqs[c] > maxFreq)
+            maxFreq = freqs[c];
+    }
+
+    unsigned int width = 0;
+    while(((maxFreq - 1) >> width) != 0)
+        width++;
+
+    unsigned int bits = FREQ_WIDTH_BITS + NUM_CHARS;
+    BitFileWriteBits(bfp, width, FREQ_WIDTH_BITS);
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        BitFileWriteBits(bfp, freqs[c] != 0, 1);
+        if(freqs[c] != 0)
+        {
+            BitFileWriteBits(bfp, freqs[c] - 1, width);
+            bits += width;
+        }
+    }
+    BitFileWriteBits(bfp, 0, (8 - bits % 8) % 8);
+}
+
+/*
+* rANS codes the block from its last symbol to its first, symbol i with
+* state i % numStreams, writing down from end so the decoder reads forward.
+* The states go last, state 0 first. Returns where the coded bytes start,
+* or nullptr when they would not fit above begin.
+*/
+static unsigned char* EncodeSymbols(const unsigned char* symbols, size_t len, int numStreams, const uint32_t* freqs,
+    unsigned char* begin, unsigned char* end)
+{
+    uint32_t starts[NUM_CHARS];
+    uint32_t start = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        starts[c] = start;
+        start += freqs[c];
+    }
+
+    uint32_t states[MAX_STREAMS];
+    for(int s = 0; s < numStreams; s++)
+        states[s] = ANS_LOW;
+
+    unsigned char* ptr = end;
+    int s = (len != 0) ? (int)((len - 1) % numStreams) : 0;
+    for(size_t i = len; i-- > 0;)
+    {
+        uint32_t x = states[s];
+        uint32_t freq = freqs[symbols[i]];
+        /* a symbol with the whole scale would take the bound past 32 bits */
+        if((uint64_t)x >= ((uint64_t)(ANS_LOW >> ANS_SCALE_BITS) << 16) * freq)
+        {
+            if(ptr - begin < 2)
+                return nullptr;
+            *--ptr = (unsigned char)(x >> 8);
+            *--ptr = (unsigned char)x;
+            x >>= 16;
+        }
+        states[s] = ((x / freq) << ANS_SCALE_BITS) + (x % freq) + starts[symbols[i]];
+        s = (s != 0) ? s - 1 : numStreams - 1;
+    }
+
+    if((size_t)(ptr - begin) < 4 * (size_t)numStreams)
+        return nullptr;
+
+    for(s = numStreams - 1; s >= 0; s--)
+    {
+        for(int i = 3; i >= 0; i--)
+            *--ptr = (unsigned char)(states[s] >> (8 * i));
+    }
+    return ptr;
+}
+
+int AnsDecodeFile(FILE* inFile, FILE* outFile)
+{
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    bit_file_t* bInFile = MakeBitFile(inFile, BF_READ);
+    if(nullptr == bInFile)
+    {
+        perror("Making Input File a BitFile");
+        return -1;
+    }
+
+    symbol_sink_t sink;
+    InitSink(&sink, outFile, nullptr, 0);
+    DECODE_STATUS status = DecodeInput(bInFile, &sink);
+    inFile = BitFileToFILE(bInFile);
+
+    switch(status)
+    {
+    case DECODE_OK:
+        return 0;
+    case DECODE_BAD_HEADER:
+        fprintf(stderr, "error: malformed file header.\n");
+        break;
+    case DECODE_BAD_VERSION:
+        fprintf(stderr, "error: unsupported stream version.\n");
+        break;
+    default:
+        fprintf(stderr, "error: malformed coded stream.\n");
+        break;
+    }
+    errno = EILSEQ;
+    return -1;
+}
+
+int AnsDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    bit_file_t bInFile;
+    InitBitBuffer(&bInFile, (unsigned char*)src, size, BF_READ);
+    symbol_sink_t sink;
+    InitSink(&sink, nullptr, dst, capacity);
+
+    DECODE_STATUS status = DecodeInput(&bInFile, &sink);
+    if(status != DECODE_OK)
+    {
+        errno = (status == DECODE_NO_ROOM) ? ENOSPC : EILSEQ;
+        return -1;
+    }
+
+    *dstSize = sink.len;
+    return 0;
+}
+
+/* blocks of a FILE are read into scratch and decoded into a block of their own, a buffer's are used in place */
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    for(int i = 0; ANS_MAGIC[i] != '\0'; i++)
+    {
+        if(BitFileGetChar(bInFile) != ANS_MAGIC[i])
+            return DECODE_BAD_HEADER;
+    }
+
+    int version = BitFileGetChar(bInFile);
+    if(version == EOF)
+        return DECODE_BAD_HEADER;
+    if(version != ANS_VERSION)
+        return DECODE_BAD_VERSION;
+
+    int numStreams = BitFileGetChar(bInFile);
+    uint32_t blockSize = 0;
+    if((numStreams < 1) || (numStreams > MAX_STREAMS)
+        || (BitFileGetBitsNum(bInFile, &blockSize, 32, sizeof(blockSize)) == EOF)
+        || (blockSize < MIN_BLOCK_SIZE) || (blockSize > MAX_BLOCK_SIZE))
+        return DECODE_BAD_HEADER;
+
+    unsigned char* block = nullptr;
+    unsigned char* scratch = nullptr;
+    if(sink->fp != nullptr)
+    {
+        block = new unsigned char[blockSize];
+        scratch = new unsigned char[CODED_BOUND(blockSize, numStreams)];
+    }
+
+    uint32_t table[ANS_SCALE];
+    DECODE_STATUS status = DECODE_OK;
+    while(status == DECODE_OK)
+    {
+        uint32_t numSymbols;
+        if(BitFileGetBitsNum(bInFile, &numSymbols, 32, sizeof(numSymbols)) == EOF)
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
+
+        if(numSymbols == 0)
+            break;
+
+        uint32_t freqs[NUM_CHARS];
+        uint32_t codedLen;
+        if((numSymbols > blockSize) || (ReadFrequencies(freqs, bInFile) != 0)
+            || (BitFileGetBitsNum(bInFile, &codedLen, 32, sizeof(codedLen)) == EOF)
+            || (codedLen > CODED_BOUND(numSymbols, numStreams)))
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
+        BuildDecodeTable(table, freqs);
+
+        const unsigned char* coded = scratch;
+        if(scratch == nullptr)
+            coded = BitFileBufferBytes(bInFile, codedLen);
+        else if(BitFileGetBytes(bInFile, scratch, codedLen) != codedLen)
+            coded = nullptr;
+
+        unsigned char* out = (block != nullptr) ? block : SinkReserve(sink, numSymbols);
+        if(coded == nullptr)
+            status = DECODE_BAD_STREAM;
+        else if(out == nullptr)
+            status = DECODE_NO_ROOM;
+        else if(DecodeSymbols(table, numStreams, coded, codedLen, out, numSymbols) != 0)
+            status = DECODE_BAD_STREAM;
+        else if(block != nullptr)
+            status = (SinkWrite(sink, block, numSymbols) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    }
+
+    delete[] scratch;
+    delete[] block;
+    return status;
+}
+
+static int ReadFrequencies(uint32_t* freqs, bit_file_t* bfp)
+{
+    unsigned int width = BitFilePeekBits(bfp, FREQ_WIDTH_BITS);
+    if((BitFileBitsAvailable(bfp) < FREQ_WIDTH_BITS) || (width > ANS_SCALE_BITS))
+        return -1;
+    BitFileSkipBits(bfp, FREQ_WIDTH_BITS);
+
+    unsigned int bits = FREQ_WIDTH_BITS + NUM_CHARS;
+    uint32_t sum = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        int present = BitFileGetBit(bfp);
+        if(present == EOF)
+            return -1;
+
+        freqs[c] = 0;
+        if(present)
+        {
+            uint32_t freq = (width != 0) ? BitFilePeekBits(bfp, width) : 0;
+            if(BitFileBitsAvailable(bfp) < width)
+                return -1;
+            BitFileSkipBits(bfp, width);
+            freqs[c] = freq + 1;
+            bits += width;
+        }
+        sum += freqs[c];
+    }
+
+    unsigned int pad = (8 - bits % 8) % 8;
+    if(pad != 0)
+    {
+        BitFilePeekBits(bfp, pad);
+        if(BitFileBitsAvailable(bfp) < pad)
+            return -1;
+        BitFileSkipBits(bfp, pad);
+    }
+    return (sum == ANS_SCALE) ? 0 : -1;
+}
+
+static void BuildDecodeTable(uint32_t* table, const uint32_t* freqs)
+{
+    uint32_t slot = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        for(uint32_t offset = 0; offset < freqs[c]; offset++)
+            table[slot++] = (uint32_t)c | ((freqs[c] - 1) << 8) | (offset << 20);
+    }
+}
+
+static inline uint32_t DecodeStep(const uint32_t* table, uint32_t x, unsigned char* out)
+{
+    uint32_t entry = table[x & (ANS_SCALE - 1)];
+    *out = (unsigned char)SLOT_SYMBOL(entry);
+    return SLOT_FREQ(entry) * (x >> ANS_SCALE_BITS) + SLOT_OFFSET(entry);
+}
+
+/* takes the next word into a state that fell below ANS_LOW, without a branch; two bytes must be left */
+static inline uint32_t RefillState(uint32_t x, const unsigned char** ptr)
+{
+    uint32_t refill = (x < ANS_LOW);
+    uint32_t word = (uint32_t)(*ptr)[0] | ((uint32_t)(*ptr)[1] << 8);
+    *ptr += 2 * refill;
+    return refill ? ((x << 16) | word) : x;
+}
+
+/*
+* Decodes len symbols from codedLen bytes. Whole rounds of one symbol per
+* state run unchecked while every state may take a word, the rest check
+* each word. The stream must end with every state back at ANS_LOW
+* and no bytes left over.
+*/
+static int DecodeSymbols(const uint32_t* table, int numStreams, const unsigned char* coded, size_t codedLen,
+    unsigned char* out, size_t len)
+{
+    const unsigned char* ptr = coded;
+    const unsigned char* end = coded + codedLen;
+    if(codedLen < 4 * (size_t)numStreams)
+        return -1;
+
+    uint32_t states[MAX_STREAMS];
+    for(int s = 0; s < numStreams; s++)
+    {
+        states[s] = (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+        ptr += 4;
+        if(states[s] < ANS_LOW)
+            return -1;
+    }
+
+    size_t i = 0;
+    if(numStreams == DEFAULT_STREAMS)
+    {
+        uint32_t x0 = states[0], x1 = states[1], x2 = states[2], x3 = states[3];
+        while((len - i >= DEFAULT_STREAMS) && ((size_t)(end - ptr) >= 2 * DEFAULT_STREAMS))
+        {
+            x0 = DecodeStep(table, x0, out + i);
+            x1 = DecodeStep(table, x1, out + i + 1);
+            x2 = DecodeStep(table, x2, out + i + 2);
+            x3 = DecodeStep(table, x3, out + i + 3);
+            x0 = RefillState(x0, &ptr);
+            x1 = RefillState(x1, &ptr);
+            x2 = RefillState(x2, &ptr);
+            x3 = RefillState(x3, &ptr);
+            i += DEFAULT_STREAMS;
+        }
+        states[0] = x0;
+        states[1] = x1;
+        states[2] = x2;
+        states[3] = x3;
+    }
+    else
+    {
+        while((len - i >= (size_t)numStreams) && ((size_t)(end - ptr) >= 2 * (size_t)numStreams))
+        {
+            for(int s = 0; s < numStreams; s++)
+            {
+                states[s] = RefillState(DecodeStep(table, states[s], out + i + s), &ptr);
+            }
+            i += numStreams;
+        }
+    }
+
+    for(int s = 0; i < len; i++)
+    {
+        uint32_t x = DecodeStep(table, states[s], out + i);
+        if(x < ANS_LOW)
+        {
+            /* the last words are read only when taken, the stream may end right after them */
+            if(end - ptr < 2)
+                return -1;
+            x = (x << 16) | (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8);
+            ptr += 2;
+        }
+        states[s] = x;
+        s = (s + 1 < numStreams) ? s + 1 : 0;
+    }
+
+    for(int s = 0; s < numStreams; s++)
+    {
+        if(states[s] != ANS_LOW)
+            return -1;
+    }
+    return (ptr == end) ? 0 : -1;
+}
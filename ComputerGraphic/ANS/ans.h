@@ -0,0 +1,30 @@
+#ifndef _ANS_H_
+#define _ANS_H_
+
+typedef struct ans_options_t
+{
+    /* symbols coded with one frequency table, from 4 KiB to 16 MiB, 0 - 64 KiB */
+    unsigned int blockSize;
+
+    /* rANS states the symbols of a block are dealt to in turn, at most 8, 0 - 4 */
+    unsigned int numStreams;
+} ans_options_t;
+
+void AnsDefaultOptions(ans_options_t* options);
+
+int AnsEncodeFile(FILE* inFile, FILE* outFile, const ans_options_t* options = nullptr);
+int AnsDecodeFile(FILE* inFile, FILE* outFile);
+
+/*
+* The same streams between buffers, without stdio or allocation. The bytes
+* written go to dstSize, when they do not fit in capacity -1 is returned with
+* errno ENOSPC. AnsEncodeBound is enough capacity for any input of size bytes
+* coded with the same options.
+*/
+size_t AnsEncodeBound(const size_t size, const ans_options_t* options = nullptr);
+int AnsEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ans_options_t* options = nullptr);
+int AnsDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize);
+
+#endif
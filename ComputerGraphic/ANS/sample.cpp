@@ -0,0 +1,56 @@
+#include "pch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ans.h"
+#include <experimental/filesystem>
+
+void main(int argc, const char* argv[])
+{
+    if(argc < 2)
+        return;
+
+    ans_options_t options;
+    AnsDefaultOptions(&options);
+    for(int i = 1; i < argc - 1; i++)
+    {
+        if((strcmp(argv[i], "-b") == 0) && (i + 1 < argc - 1))
+            options.blockSize = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-s") == 0) && (i + 1 < argc - 1))
+            options.numStreams = atoi(argv[++i]);
+    }
+
+    std::experimental::filesystem::path filePath = argv[argc - 1];
+    std::string ext = filePath.extension().string();
+
+    if(ext.compare(".Huffman") == 0 || ext.compare(".Rlc") == 0 || ext.compare(".Arc") == 0 || ext.compare(".dic") == 0)
+        return;
+
+    bool encode = ext.compare(".Ans") != 0;
+    FILE* inFile = fopen(filePath.string().c_str(), "rb");
+    if(encode)
+        filePath.replace_extension(".Ans");
+    else
+        filePath.replace_extension("_decAns.pgm");
+    FILE* outFile = fopen(filePath.string().c_str(), "wb");
+
+    if(inFile == nullptr)
+    {
+        if(outFile != nullptr)
+            fclose(outFile);
+        return;
+    }
+    else if(outFile == nullptr)
+    {
+        fclose(inFile);
+        return;
+    }
+
+    if(encode)
+        AnsEncodeFile(inFile, outFile, &options);
+    else
+        AnsDecodeFile(inFile, outFile);
+
+    fclose(inFile);
+    fclose(outFile);
+}
\ No newline at end of file
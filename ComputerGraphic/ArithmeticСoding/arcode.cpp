@@ -1,10 +1,15 @@
 #include "pch.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <errno.h>
 #include <assert.h>
+#include <new>
 #include "arcode.h"
 #include "bitfile.h"
+#include "parallel.h"
+#include "sink.h"
 
 #if !(USHRT_MAX < ULONG_MAX)
 #error "Implementation requires USHRT_MAX < ULONG_MAX"
@@ -14,10 +19,25 @@
 
 typedef unsigned short probability_t;
 
+/* symbols of the model, all bytes and EOF_CHAR, rounded up to a power of two */
+#define MODEL_SIZE  512
+
+/*
+* The model keeps the count of every symbol and a binary indexed tree over
+* them: tree[i] holds the counts of symbols i - (i & -i) to i - 1, so the
+* counts below a symbol, an update and the symbol for a probability each
+* take log2(MODEL_SIZE) steps.
+*/
+typedef struct
+{
+    unsigned int counts[EOF_CHAR + 1];
+    unsigned int tree[MODEL_SIZE + 1];
+    unsigned int total;
+} model_t;
+
 typedef struct
 {
-    probability_t ranges[EOF_CHAR + 2];
-    probability_t cumulativeProb;
+    model_t model;
 
     probability_t lower;
     probability_t upper;
@@ -32,29 +52,369 @@ typedef struct
 
 #define MASK_BIT(x) (probability_t)(1 << (PRECISION - (1 + (x))))
 
-#define LOWER(c)    (c)
-#define UPPER(c)    ((c) + 1)
+/*
+* The range coder keeps a 32 bit range above RANGE_TOP and a low end with a
+* 33rd bit for the carry, moving a byte out whenever the range drops below
+* it. The range is at least RANGE_TOP, so the model total may go up to
+* RANGE_LIMIT and symbols are counted in steps of RANGE_INCREMENT.
+*/
+#define RANGE_TOP           (1u << 24)
+#define RANGE_LIMIT         (1u << 16)
+#define RANGE_INCREMENT     32
+#define RANGE_FLUSH_BYTES   5
+
+/* binary decisions are coded with the probability of a 1 in BIT_PROBABILITY_BITS bits */
+#define BIT_PROBABILITY_BITS    12
+
+/*
+* The static model counts the whole input first and scales the counts to
+* STATIC_TOTAL, which the stream header carries. The range coder then
+* shifts by the total instead of dividing, and the decoder maps a scaled
+* probability straight to its symbol with a table of STATIC_TOTAL entries.
+*/
+#define STATIC_SCALE_BITS   (PRECISION - 2)
+#define STATIC_TOTAL        (1u << STATIC_SCALE_BITS)
+
+/* a symbol and its count for every byte, then symbol 0 with count 0 */
+#define STATIC_HEADER_SIZE  (((EOF_CHAR + 1) * (8 + STATIC_SCALE_BITS) + 7) / 8)
+
+typedef struct
+{
+    unsigned int counts[EOF_CHAR + 1];
+    unsigned int below[EOF_CHAR + 1];
+} static_model_t;
+
+/*
+* The shift format adapts like the range one, but codes with frequencies
+* rebuilt from the counts every so often to add up to SHIFT_TOTAL. Rebuilds
+* come after SHIFT_FIRST_REBUILD symbols, then twice as far apart each time
+* up to SHIFT_MAX_REBUILD. With the model this far behind the counts a
+* longer memory than RANGE_LIMIT codes smaller, so counts are halved at
+* SHIFT_LIMIT.
+*
+* The coder takes the range apart with a shift. The decoder estimates the
+* scaled value from reciprocals of the top SHIFT_RECIPROCAL_BITS bits of
+* the range unit, never above the true value and at most SHIFT_TOTAL >>
+* (SHIFT_RECIPROCAL_BITS - 1) below it, starts at the symbol the lookup
+* gives for that part of the total and steps up to the symbol. No symbol
+* needs a division.
+*/
+#define SHIFT_SCALE_BITS    15
+#define SHIFT_TOTAL         (1u << SHIFT_SCALE_BITS)
+#define SHIFT_FIRST_REBUILD 32
+#define SHIFT_MAX_REBUILD   4096
+#define SHIFT_LIMIT         (1u << 18)
+#define SHIFT_RECIPROCAL_BITS   10
+#define SHIFT_LOOKUP_BITS   9
+
+typedef struct
+{
+    unsigned int freqs[EOF_CHAR + 1];
+    unsigned int below[MODEL_SIZE];
+    unsigned short lookup[1 << SHIFT_LOOKUP_BITS];
+    uint32_t reciprocals[1 << (SHIFT_RECIPROCAL_BITS - 1)];
+    unsigned int counts[EOF_CHAR + 1];
+    unsigned int total;
+    unsigned int interval;
+    unsigned int untilRebuild;
+} shift_model_t;
+
+/*
+* The image format codes the pixels of a raster as the difference from a
+* prediction out of their west, north and north west neighbours, with one
+* adaptive model per level of the gradient around the pixel. Bytes before
+* the raster, like a PGM header, have a model of their own. The stream
+* header keeps the raster width and where the raster starts.
+*/
+#define IMAGE_CONTEXTS      8
+#define IMAGE_HEADER_SIZE   8
+#define MAX_IMAGE_WIDTH     (1u << 20)
+
+/*
+* The mix format codes a flag for every byte telling that one more follows,
+* then the 8 bits of the byte from the top. Every bit gets a probability
+* from MIX_MODELS models, tables of adaptive probabilities indexed by a
+* context and the bits of the byte so far. A logistic mixer adds their
+* stretched probabilities with weights trained as it goes and squashes the
+* sum back. The models take the 0, 1, 2, 3 and 4 bytes before. In a raster
+* found like the image format the last three take the pixels above and
+* above right, above and left, and the image prediction with its gradient
+* level instead. The stream header is the image one.
+*/
+#define MIX_MODELS          5
+#define MIX_INPUTS          (MIX_MODELS + 1)
+#define MIX_HASH_BITS       20
+#define MIX_TABLE_SIZE      ((1u << 8) + (1u << 16) + 3 * (1u << MIX_HASH_BITS))
+#define MIX_WEIGHT_SETS     (IMAGE_CONTEXTS << 8)
+#define MIX_COUNT_LIMIT     255
+#define MIX_LEARNING_SHIFT  11
+
+typedef struct
+{
+    /* probability in the top 22 bits, times seen in the low 10 */
+    uint32_t* table;
+    uint32_t more;
+    uint32_t contexts[MIX_MODELS];
+    uint32_t* slots[MIX_MODELS];
+
+    int weights[MIX_WEIGHT_SETS][MIX_INPUTS];
+    int* weightSet;
+    int set;
+    int stretched[MIX_INPUTS];
+    int mixed;
+
+    short stretch[1 << BIT_PROBABILITY_BITS];
+    int rates[MIX_COUNT_LIMIT + 1];
+    uint32_t history;
+} mix_model_t;
+
+/*
+* The tree format codes every symbol as 9 binary decisions down a tree
+* of adaptive probabilities, the first telling EOF_CHAR from the bytes.
+* A probability moves 1 / 2^TREE_MOVE_BITS of the way to every bit it
+* codes, so it stays 31 away from either end. Nothing is searched,
+* summed or divided.
+*/
+#define TREE_MOVE_BITS      5
+
+/* the row above the next pixel, already replaced by the current row left of it */
+typedef struct
+{
+    unsigned char* above;
+    unsigned int width;
+    unsigned int x;
+    bool firstRow;
+    unsigned char west;
+    unsigned char northWest;
+} raster_t;
+
+typedef struct
+{
+    uint64_t low;
+    uint32_t range;
+    uint32_t code;
+    uint32_t cache;
+    uint64_t cacheSize;
+    uint32_t overrun;
+} range_coder_t;
+
+/*
+* Streams other than the bitwise one start with two 0xFF bytes and the
+* format. A bitwise stream starts with 0xFF only when EOF_CHAR is its first
+* symbol, and that stream is 0xFF 0x40.
+*/
+#define AR_SIGNATURE        0xFF
+#define AR_HEADER_SIZE      3
+
+/*
+* A block stream sets AR_BLOCK_FLAG in the format. The block size and the
+* symbol count follow, then the index of coded block sizes and the blocks.
+* Each block is a stream of its own in the format, padded to a byte, so
+* blocks are coded and decoded apart on the thread pool. A FILE is decoded
+* BLOCK_BATCH blocks at a time.
+*/
+#define AR_BLOCK_FLAG       0x80
+#define AR_BLOCK_HEADER_SIZE    (AR_HEADER_SIZE + 8)
+#define MIN_BLOCK_SIZE      (1 << 12)
+#define MAX_BLOCK_SIZE      (1 << 24)
+#define BLOCK_BATCH         64
+
+/* every mix block sets up tables of MIX_TABLE_SIZE entries, smaller blocks would spend more on them than on coding */
+#define MIN_MIX_BLOCK_SIZE  (1 << 20)
+
+/*
+* A stream whose models start from the prior of a trained dictionary sets
+* AR_DICTIONARY_FLAG in the format and follows it with the dictionary id.
+* The prior is scaled to PRIOR_TOTAL counts, worth PRIOR_TOTAL /
+* RANGE_INCREMENT symbols of the input, so the models still move to what
+* the input brings.
+*/
+#define AR_DICTIONARY_FLAG  0x40
+#define PRIOR_TOTAL         (1u << 13)
+
+/* input read from a FILE a block at a time, decoded symbols written a block at a time */
+#define IO_BLOCK_SIZE       (1 << 12)
+
+/* the input of an encoder: a FILE, or size bytes at data when fp is nullptr */
+typedef struct
+{
+    FILE* fp;
+    const unsigned char* data;
+    size_t size;
+} symbol_source_t;
+
+typedef struct
+{
+    const unsigned char* data;
+    size_t size;
+    size_t blockSize;
+    const ar_options_t* options;
+
+    /* one entry per block, a coded entry of nullptr when the block could not be coded for lack of memory */
+    unsigned char** coded;
+    uint32_t* codedSizes;
+} block_job_t;
 
-static void WriteHeader(bit_file_t* bfpOut, stats_t* stats);
-static int ReadHeader(bit_file_t* bfpIn, stats_t* stats);
+/* coded and decoded blocks of a batch, one after another */
+typedef struct
+{
+    unsigned char* coded;
+    const size_t* codedOffsets;
+    unsigned char* decoded;
+    size_t blockSize;
+    const size_t* blockLens;
+    const dictionary_t* dictionary;
+    int* status;
+} block_decode_job_t;
+
+/* why decoding stopped, ArDecodeFile reports it on stderr */
+typedef enum
+{
+    DECODE_OK = 0,
+    DECODE_BAD_STREAM,
+    DECODE_BAD_FORMAT,
+    DECODE_NO_ROOM,
+    DECODE_NO_DICTIONARY,
+    DECODE_NO_MEMORY
+} DECODE_STATUS;
+
+static void WriteHeader(bit_file_t* bfpOut, const static_model_t* model);
+static int ReadHeader(bit_file_t* bfpIn, static_model_t* model);
 
 static void ApplySymbolRange(int symbol, stats_t * stats);
 
 static void WriteEncodedBits(bit_file_t* bfpOut, stats_t* stats);
 static void WriteRemaining(bit_file_t* bfpOut, stats_t* stats);
-static int BuildProbabilityRangeList(FILE* fpIn, stats_t* stats);
-static void InitializeAdaptiveProbabilityRangeList(stats_t* stats);
+static int BuildProbabilityRangeList(symbol_source_t* source, static_model_t* model);
+static void SymbolCountToProbabilityRanges(static_model_t* model);
+static void InitializeAdaptiveProbabilityRangeList(model_t* model);
+static void BuildCountTree(model_t* model);
+static unsigned int CountsBelow(const model_t* model, int symbol);
+static void UpdateModel(model_t* model, int symbol, unsigned int increment, unsigned int limit);
+static void ApplyPrior(model_t* model, const dictionary_t* dictionary);
 
 static void InitializeDecoder(bit_file_t* bfpOut, stats_t* stats);
 static probability_t GetUnscaledCode(stats_t* stats);
-static int GetSymbolFromProbability(probability_t probability, stats_t* stats);
+static int GetSymbolFromProbability(unsigned int probability, const model_t* model, unsigned int* below);
 static void ReadEncodedBits(bit_file_t* bfpIn, stats_t* stats);
 
-int ArEncodeFile(FILE* inFile, FILE* outFile)
+static int CheckOptions(const ar_options_t* options);
+static int EncodeInput(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options);
+static int EncodeStream(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options);
+static int EncodeBlocks(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options);
+static void EncodeBlockJob(void* context, int index);
+static int EncodeBlockBuffer(const unsigned char* data, size_t size, bit_file_t* bOutFile, const ar_options_t* options,
+    int numBlocks);
+static void PadToByte(bit_file_t* bfp);
+static void EncodeBitwise(symbol_source_t* source, bit_file_t* bOutFile);
+static void EncodeRange(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary);
+static int EncodeStatic(symbol_source_t* source, bit_file_t* bOutFile);
+static int EncodeImage(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options);
+static void EncodeShift(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary);
+static int EncodeMix(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options);
+static void EncodeTree(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary);
+static unsigned int FindRaster(const unsigned char* symbols, size_t len, const ar_options_t* options, size_t* offset);
+static int ParsePgmHeader(const unsigned char* data, size_t len, unsigned int* width, size_t* offset);
+static size_t SourceRead(symbol_source_t* source, const unsigned char** symbols, unsigned char* block);
+
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink, const ar_options_t* options);
+static DECODE_STATUS DecodeStream(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary);
+static DECODE_STATUS DecodeBlocks(bit_file_t* bInFile, symbol_sink_t* sink, int format, const ar_options_t* options);
+static DECODE_STATUS DecodeBlockBuffer(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary, size_t blockSize, size_t numSymbols,
+    int numBlocks);
+static void DecodeBlockJob(void* context, int index);
+static DECODE_STATUS DecodeBlock(unsigned char* coded, size_t codedSize, unsigned char* block, size_t blockLen,
+    const dictionary_t* dictionary);
+static DECODE_STATUS DecodeBitwise(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeRange(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary);
+static DECODE_STATUS DecodeStatic(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeImage(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeShift(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary);
+static DECODE_STATUS DecodeMix(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeTree(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary);
+
+static void RangeEncoderInit(range_coder_t* coder);
+static void RangeEncode(range_coder_t* coder, bit_file_t* bfpOut, model_t* model, int symbol);
+static void RangeShiftLow(range_coder_t* coder, bit_file_t* bfpOut);
+static void RangeEncoderFlush(range_coder_t* coder, bit_file_t* bfpOut);
+static void RangeDecoderInit(range_coder_t* coder, bit_file_t* bfpIn);
+static int RangeDecode(range_coder_t* coder, bit_file_t* bfpIn, model_t* model);
+static void RangeEncodeStatic(range_coder_t* coder, bit_file_t* bfpOut, const static_model_t* model, int symbol);
+static int RangeDecodeStatic(range_coder_t* coder, bit_file_t* bfpIn, const static_model_t* model,
+    const unsigned short* lookup);
+
+static void InitShiftModel(shift_model_t* model, const dictionary_t* dictionary);
+static void RebuildShiftModel(shift_model_t* model);
+static void RangeEncodeShift(range_coder_t* coder, bit_file_t* bfpOut, shift_model_t* model, int symbol);
+static int RangeDecodeShift(range_coder_t* coder, bit_file_t* bfpIn, shift_model_t* model);
+
+static void RangeEncodeBit(range_coder_t* coder, bit_file_t* bfpOut, unsigned int probability, int bit);
+static int RangeDecodeBit(range_coder_t* coder, bit_file_t* bfpIn, unsigned int probability);
+static void InitTree(unsigned short* tree, const dictionary_t* dictionary);
+static void RangeEncodeTree(range_coder_t* coder, bit_file_t* bfpOut, unsigned short* tree, int symbol);
+static int RangeDecodeTree(range_coder_t* coder, bit_file_t* bfpIn, unsigned short* tree);
+static void TreeAdapt(unsigned short* probability, int bit);
+
+static mix_model_t* NewMixModel(void);
+static void DeleteMixModel(mix_model_t* model);
+static void MixSelectContexts(mix_model_t* model, const raster_t* raster, bool pixel);
+static unsigned int MixPredict(mix_model_t* model, unsigned int partial);
+static void MixUpdate(mix_model_t* model, int bit);
+static unsigned int MixMoreProbability(const mix_model_t* model);
+static void MixAdapt(uint32_t* slot, int bit, const int* rates);
+static int Squash(int stretched);
+
+static int InitRaster(raster_t* raster, unsigned int width);
+static int PixelContext(const raster_t* raster, int* prediction);
+static void RasterPush(raster_t* raster, unsigned char pixel);
+
+void ArDefaultOptions(ar_options_t* options)
+{
+    options->format = AR_FORMAT_BITWISE;
+    options->width = 0;
+    options->blockSize = 0;
+    options->numThreads = 0;
+    options->dictionary = nullptr;
+}
+
+/*
+* -1 with errno EINVAL for a format or block size the streams can not hold,
+* or a dictionary with a format whose models do not start from a prior
+*/
+static int CheckOptions(const ar_options_t* options)
+{
+    if(((unsigned int)options->format >= AR_NO_FORMAT)
+        || ((options->blockSize != 0) && ((options->blockSize < MIN_BLOCK_SIZE) || (options->blockSize > MAX_BLOCK_SIZE)))
+        || ((options->blockSize != 0) && (options->format == AR_FORMAT_IMAGE))
+        || ((options->blockSize != 0) && (options->format == AR_FORMAT_MIX) && (options->blockSize < MIN_MIX_BLOCK_SIZE))
+        || ((options->dictionary != nullptr) && (options->format != AR_FORMAT_RANGE)
+            && (options->format != AR_FORMAT_SHIFT) && (options->format != AR_FORMAT_TREE)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int ArEncodeFile(FILE* inFile, FILE* outFile, const ar_options_t* options)
 {
     if(nullptr == inFile)
         inFile = stdin;
 
+    ar_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        ArDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    if(CheckOptions(options) != 0)
+    {
+        fprintf(stderr, "Error: Unknown stream format %d, block size %u or a dictionary the format can not use\n",
+            (int)options->format, options->blockSize);
+        return -1;
+    }
+
     bit_file_t* bOutFile;
     if(outFile == nullptr)
         bOutFile = MakeBitFile(stdout, BF_WRITE);
@@ -67,306 +427,1630 @@ int ArEncodeFile(FILE* inFile, FILE* outFile)
         return -1;
     }
 
-    stats_t stats;
-    InitializeAdaptiveProbabilityRangeList(&stats);
-
-    stats.lower = 0;
-    stats.upper = ~0;
-    stats.underflowBits = 0;
+    symbol_source_t source = { inFile, nullptr, 0 };
+    int result = EncodeInput(&source, bOutFile, options);
+    outFile = BitFileToFILE(bOutFile);
 
-    int c;
-    while((c = fgetc(inFile)) != EOF)
+    if(result != 0)
     {
-        ApplySymbolRange(c, &stats);
-        WriteEncodedBits(bOutFile, &stats);
+        if((options->blockSize == 0) && (options->format == AR_FORMAT_STATIC))
+            fprintf(stderr, "Error: Static model needs a seekable input file\n");
+        else if(errno == EFBIG)
+            fprintf(stderr, "Error: Input file is 4 GiB or more\n");
+        else if(errno == ENOMEM)
+            fprintf(stderr, "Error: Out of memory\n");
+        else
+            fprintf(stderr, "Error: Reading input file: %s\n", strerror(errno));
     }
 
-    ApplySymbolRange(EOF_CHAR, &stats);
-    WriteEncodedBits(bOutFile, &stats);
-    WriteRemaining(bOutFile, &stats);
-    outFile = BitFileToFILE(bOutFile);
-
-    return 0;
+    return result;
 }
 
-static void SymbolCountToProbabilityRanges(stats_t *stats)
+static int EncodeInput(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options)
 {
-    stats->ranges[0] = 0;
-    stats->ranges[UPPER(EOF_CHAR)] = 1;
-    stats->cumulativeProb++;
+    if(options->blockSize != 0)
+        return EncodeBlocks(source, bOutFile, options);
 
-    for(int c = 1; c <= UPPER(EOF_CHAR); c++)
-        stats->ranges[c] += stats->ranges[c - 1];
+    return EncodeStream(source, bOutFile, options);
 }
 
-static int BuildProbabilityRangeList(FILE *fpIn, stats_t *stats)
+/*
+* -1 when the static model can not read its FILE input twice, or with
+* errno ENOMEM when the models of a format can not be allocated
+*/
+static int EncodeStream(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options)
 {
-    if(fpIn == nullptr)
-        return -1;
+    if(options->format == AR_FORMAT_BITWISE)
+    {
+        EncodeBitwise(source, bOutFile);
+        return 0;
+    }
 
-    unsigned long countArray[EOF_CHAR];
-    for(int c = 0; c < EOF_CHAR; c++)
-        countArray[c] = 0;
+    BitFilePutChar(AR_SIGNATURE, bOutFile);
+    BitFilePutChar(AR_SIGNATURE, bOutFile);
+    if(options->dictionary != nullptr)
+    {
+        BitFilePutChar(options->format | AR_DICTIONARY_FLAG, bOutFile);
+        BitFileWriteBits(bOutFile, options->dictionary->id, 32);
+    }
+    else
+    {
+        BitFilePutChar(options->format, bOutFile);
+    }
+
+    if(options->format == AR_FORMAT_STATIC)
+        return EncodeStatic(source, bOutFile);
+
+    if(options->format == AR_FORMAT_IMAGE)
+        return EncodeImage(source, bOutFile, options);
+    if(options->format == AR_FORMAT_MIX)
+        return EncodeMix(source, bOutFile, options);
+
+    if(options->format == AR_FORMAT_SHIFT)
+        EncodeShift(source, bOutFile, options->dictionary);
+    else if(options->format == AR_FORMAT_TREE)
+        EncodeTree(source, bOutFile, options->dictionary);
+    else
+        EncodeRange(source, bOutFile, options->dictionary);
+    return 0;
+}
 
-    int c;
-    unsigned long totalCount = 0;
-    while((c = fgetc(fpIn)) != EOF)
+/*
+* The input is held in memory and cut into blocks of blockSize symbols,
+* each coded from fresh models. Nothing depends on which thread coded a
+* block, so the output is the same for any number of threads. -1 when a
+* FILE input can not be read or is 4 GiB or more, or with errno ENOMEM
+* when the input or a block can not be held.
+*/
+static int EncodeBlocks(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options)
+{
+    const unsigned char* data = source->data;
+    size_t size = source->size;
+    unsigned char* input = nullptr;
+    if(source->fp != nullptr)
     {
-        if(totalCount == ULONG_MAX)
+        size_t capacity = 1 << 20;
+        input = new (std::nothrow) unsigned char[capacity];
+        if(input == nullptr)
         {
-            fprintf(stderr, "Error: file too large\n");
+            errno = ENOMEM;
             return -1;
         }
 
-        countArray[c]++;
-        totalCount++;
-    }
+        size = 0;
+        size_t len;
+        while((len = fread(input + size, 1, capacity - size, source->fp)) != 0)
+        {
+            size += len;
+            if(size == capacity)
+            {
+                unsigned char* larger = new (std::nothrow) unsigned char[2 * capacity];
+                if(larger == nullptr)
+                {
+                    delete[] input;
+                    errno = ENOMEM;
+                    return -1;
+                }
+                memcpy(larger, input, size);
+                delete[] input;
+                input = larger;
+                capacity *= 2;
+            }
+        }
+        data = input;
 
-    if(totalCount >= MAX_PROBABILITY)
-    {
-        unsigned long rescaleValue = (totalCount / MAX_PROBABILITY) + 1;
-        for(c = 0; c < EOF_CHAR; c++)
+        if(ferror(source->fp))
         {
-            if(countArray[c] > rescaleValue)
-                countArray[c] /= rescaleValue;
-            else if(countArray[c] != 0)
-                countArray[c] = 1;
+            delete[] input;
+            return -1;
         }
     }
 
-    stats->ranges[0] = 0;
-    stats->cumulativeProb = 0;
-    for(c = 0; c < EOF_CHAR; c++)
+    if(size > UINT32_MAX)
+    {
+        delete[] input;
+        errno = EFBIG;
+        return -1;
+    }
+
+    BitFilePutChar(AR_SIGNATURE, bOutFile);
+    BitFilePutChar(AR_SIGNATURE, bOutFile);
+    BitFilePutChar(options->format | AR_BLOCK_FLAG, bOutFile);
+    BitFileWriteBits(bOutFile, options->blockSize, 32);
+    BitFileWriteBits(bOutFile, (uint32_t)size, 32);
+
+    int numBlocks = (int)((size + options->blockSize - 1) / options->blockSize);
+    if(source->fp == nullptr)
+        return EncodeBlockBuffer(data, size, bOutFile, options, numBlocks);
+
+    ar_options_t streamOptions = *options;
+    streamOptions.blockSize = 0;
+
+    block_job_t job;
+    job.data = data;
+    job.size = size;
+    job.blockSize = options->blockSize;
+    job.options = &streamOptions;
+    job.coded = new (std::nothrow) unsigned char*[numBlocks + 1];
+    job.codedSizes = new (std::nothrow) uint32_t[numBlocks + 1];
+    if((job.coded == nullptr) || (job.codedSizes == nullptr))
+    {
+        delete[] job.coded;
+        delete[] job.codedSizes;
+        delete[] input;
+        errno = ENOMEM;
+        return -1;
+    }
+    ParallelFor(numBlocks, options->numThreads, EncodeBlockJob, &job);
+
+    bool coded = true;
+    for(int i = 0; i < numBlocks; i++)
+        coded = coded && (job.coded[i] != nullptr);
+
+    if(!coded)
+    {
+        for(int i = 0; i < numBlocks; i++)
+            delete[] job.coded[i];
+        delete[] job.coded;
+        delete[] job.codedSizes;
+        delete[] input;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(int i = 0; i < numBlocks; i++)
+        BitFileWriteBits(bOutFile, job.codedSizes[i], 32);
+
+    for(int i = 0; i < numBlocks; i++)
     {
-        stats->ranges[UPPER(c)] = countArray[c];
-        stats->cumulativeProb += countArray[c];
+        BitFilePutBytes(bOutFile, job.coded[i], job.codedSizes[i]);
+        delete[] job.coded[i];
     }
 
-    SymbolCountToProbabilityRanges(stats);
+    delete[] job.coded;
+    delete[] job.codedSizes;
+    delete[] input;
     return 0;
 }
 
-static void WriteHeader(bit_file_t* bfpOut, stats_t* stats)
+static void EncodeBlockJob(void* context, int index)
 {
-    probability_t previous = 0;
-    for(int c = 0; c <= (EOF_CHAR - 1); c++)
+    block_job_t* job = (block_job_t*)context;
+    size_t start = (size_t)index * job->blockSize;
+    size_t blockLen = job->size - start;
+    if(blockLen > job->blockSize)
+        blockLen = job->blockSize;
+
+    size_t bound = ArEncodeBound(blockLen, job->options) + 1;
+    unsigned char* coded = new (std::nothrow) unsigned char[bound];
+    job->coded[index] = coded;
+    if(coded == nullptr)
+        return;
+
+    bit_file_t bfp;
+    InitBitBuffer(&bfp, coded, bound, BF_WRITE);
+    symbol_source_t source = { nullptr, job->data + start, blockLen };
+    if(EncodeStream(&source, &bfp, job->options) != 0)
     {
-        if(stats->ranges[UPPER(c)] > previous)
-        {
-            BitFilePutChar((char)c, bfpOut);
-            previous = (stats->ranges[UPPER(c)] - previous);
-            BitFilePutBitsNum(bfpOut, &previous, (PRECISION - 2), sizeof(probability_t));
-            previous = stats->ranges[UPPER(c)];
-        }
+        delete[] coded;
+        job->coded[index] = nullptr;
+        return;
     }
-
-    BitFilePutChar(0x00, bfpOut);
-    previous = 0;
-    BitFilePutBits(bfpOut, (void*)&previous, PRECISION - 2);
+    PadToByte(&bfp);
+    job->codedSizes[index] = (uint32_t)CloseBitBuffer(&bfp);
 }
 
-static void InitializeAdaptiveProbabilityRangeList(stats_t* stats)
+/*
+* Blocks coded one after another on the calling thread straight into a bit
+* file over memory, their sizes go into the index left in front of them.
+*/
+static int EncodeBlockBuffer(const unsigned char* data, size_t size, bit_file_t* bOutFile, const ar_options_t* options,
+    int numBlocks)
 {
-    stats->ranges[0] = 0;
-    for(int c = 1; c <= UPPER(EOF_CHAR); c++)
-        stats->ranges[c] = stats->ranges[c - 1] + 1;
+    size_t indexSize = (size_t)numBlocks * 4;
+    unsigned char* index = BitFileBufferBytes(bOutFile, indexSize);
+    if(index == nullptr)
+        return 0;   /* out of room, the bit file has its error set */
+
+    ar_options_t streamOptions = *options;
+    streamOptions.blockSize = 0;
+
+    bit_file_t bIndex;
+    InitBitBuffer(&bIndex, index, indexSize, BF_WRITE);
+    for(int i = 0; i < numBlocks; i++)
+    {
+        size_t start = (size_t)i * options->blockSize;
+        symbol_source_t source = { nullptr, data + start, size - start };
+        if(source.size > options->blockSize)
+            source.size = options->blockSize;
+
+        const unsigned char* blockStart = BitFileBufferBytes(bOutFile, 0);
+        if(EncodeStream(&source, bOutFile, &streamOptions) != 0)
+            return -1;
+        PadToByte(bOutFile);
+        const unsigned char* blockEnd = BitFileBufferBytes(bOutFile, 0);
+        if((blockStart == nullptr) || (blockEnd == nullptr))
+            return 0;
 
-    stats->cumulativeProb = UPPER(EOF_CHAR);
+        BitFileWriteBits(&bIndex, (uint32_t)(blockEnd - blockStart), 32);
+    }
+    CloseBitBuffer(&bIndex);
+    return 0;
 }
 
-static void ApplySymbolRange(int symbol, stats_t* stats)
+/* zero bits up to the next byte, a bitwise stream may end inside one */
+static void PadToByte(bit_file_t* bfp)
 {
-    unsigned long range = (unsigned long)(stats->upper - stats->lower) + 1;
-    unsigned long rescaled = (unsigned long)(stats->ranges[UPPER(symbol)]) * range;
-    rescaled /= (unsigned long)(stats->cumulativeProb);
+    BitFileWriteBits(bfp, 0, (8 - bfp->bitCount % 8) % 8);
+}
 
-    stats->upper = stats->lower + (probability_t)rescaled - 1;
+/* the next symbols of the input, read into block from a FILE, 0 at its end */
+static size_t SourceRead(symbol_source_t* source, const unsigned char** symbols, unsigned char* block)
+{
+    if(source->fp != nullptr)
+    {
+        *symbols = block;
+        return fread(block, 1, IO_BLOCK_SIZE, source->fp);
+    }
 
-    rescaled = (unsigned long)(stats->ranges[LOWER(symbol)]) * range;
-    rescaled /= (unsigned long)(stats->cumulativeProb);
+    size_t len = source->size;
+    *symbols = source->data;
+    source->data += len;
+    source->size = 0;
+    return len;
+}
 
-    stats->lower = stats->lower + (probability_t)rescaled;
-    stats->cumulativeProb++;
+static void EncodeBitwise(symbol_source_t* source, bit_file_t* bOutFile)
+{
+    stats_t stats;
+    InitializeAdaptiveProbabilityRangeList(&stats.model);
 
-    for(int i = UPPER(symbol); i <= UPPER(EOF_CHAR); i++)
-        stats->ranges[i] += 1;
+    stats.lower = 0;
+    stats.upper = ~0;
+    stats.underflowBits = 0;
 
-    if(stats->cumulativeProb >= MAX_PROBABILITY)
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    while((len = SourceRead(source, &symbols, block)) != 0)
     {
-        stats->cumulativeProb = 0;
-        probability_t original = 0;
-        probability_t delta;
-        for(int i = 1; i <= UPPER(EOF_CHAR); i++)
+        for(size_t i = 0; i < len; i++)
         {
-            delta = stats->ranges[i] - original;
-            original = stats->ranges[i];
-
-            if(delta <= 2)
-                stats->ranges[i] = stats->ranges[i - 1] + 1;
-            else
-                stats->ranges[i] = stats->ranges[i - 1] + (delta / 2);
-
-            stats->cumulativeProb += (stats->ranges[i] - stats->ranges[i - 1]);
+            ApplySymbolRange(symbols[i], &stats);
+            WriteEncodedBits(bOutFile, &stats);
         }
     }
+
+    ApplySymbolRange(EOF_CHAR, &stats);
+    WriteEncodedBits(bOutFile, &stats);
+    WriteRemaining(bOutFile, &stats);
 }
 
-static void WriteEncodedBits(bit_file_t* bfpOut, stats_t* stats)
+static void EncodeRange(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary)
 {
-    while(true)
+    model_t model;
+    InitializeAdaptiveProbabilityRangeList(&model);
+    if(dictionary != nullptr)
+        ApplyPrior(&model, dictionary);
+
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    while((len = SourceRead(source, &symbols, block)) != 0)
     {
-        if((stats->upper & MASK_BIT(0)) == (stats->lower & MASK_BIT(0)))
-        {
-            BitFilePutBit((stats->upper & MASK_BIT(0)) != 0, bfpOut);
-
-            while(stats->underflowBits > 0)
-            {
-                BitFilePutBit((stats->upper & MASK_BIT(0)) == 0, bfpOut);
-                stats->underflowBits--;
-            }
-        }
-        else if((stats->lower & MASK_BIT(1)) && !(stats->upper & MASK_BIT(1)))
-        {
-            stats->underflowBits += 1;
-            stats->lower &= ~(MASK_BIT(0) | MASK_BIT(1));
-            stats->upper |= MASK_BIT(1);
-        }
-        else
-        {
-            return;
-        }
-        stats->lower <<= 1;
-        stats->upper <<= 1;
-        stats->upper |= 1;
+        for(size_t i = 0; i < len; i++)
+            RangeEncode(&coder, bOutFile, &model, symbols[i]);
     }
+
+    RangeEncode(&coder, bOutFile, &model, EOF_CHAR);
+    RangeEncoderFlush(&coder, bOutFile);
 }
 
-static void WriteRemaining(bit_file_t* bfpOut, stats_t* stats)
+static void EncodeShift(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary)
 {
-    BitFilePutBit((stats->lower & MASK_BIT(1)) != 0, bfpOut);
-    for(stats->underflowBits++; stats->underflowBits > 0; stats->underflowBits--)
-        BitFilePutBit((stats->lower & MASK_BIT(1)) == 0, bfpOut);
+    shift_model_t model;
+    InitShiftModel(&model, dictionary);
+
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    while((len = SourceRead(source, &symbols, block)) != 0)
+    {
+        for(size_t i = 0; i < len; i++)
+            RangeEncodeShift(&coder, bOutFile, &model, symbols[i]);
+    }
+
+    RangeEncodeShift(&coder, bOutFile, &model, EOF_CHAR);
+    RangeEncoderFlush(&coder, bOutFile);
 }
 
-int ArDecodeFile(FILE* inFile, FILE* outFile)
+static void EncodeTree(symbol_source_t* source, bit_file_t* bOutFile, const dictionary_t* dictionary)
 {
-    if(nullptr == outFile)
-        outFile = stdout;
+    unsigned short tree[MODEL_SIZE];
+    InitTree(tree, dictionary);
 
-    if(nullptr == inFile)
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    while((len = SourceRead(source, &symbols, block)) != 0)
     {
-        fprintf(stderr, "Error: Invalid input file\n");
-        return -1;
+        for(size_t i = 0; i < len; i++)
+            RangeEncodeTree(&coder, bOutFile, tree, symbols[i]);
     }
 
-    bit_file_t* bInFile = MakeBitFile(inFile, BF_READ);
+    RangeEncodeTree(&coder, bOutFile, tree, EOF_CHAR);
+    RangeEncoderFlush(&coder, bOutFile);
+}
 
-    if(nullptr == bInFile)
-    {
-        fprintf(stderr, "Error: Unable to create binary input file\n");
+static int EncodeStatic(symbol_source_t* source, bit_file_t* bOutFile)
+{
+    static_model_t model;
+    if(BuildProbabilityRangeList(source, &model) != 0)
         return -1;
-    }
 
-    stats_t stats;
-    InitializeAdaptiveProbabilityRangeList(&stats);
-    InitializeDecoder(bInFile, &stats);
+    WriteHeader(bOutFile, &model);
 
-    int c;
-    probability_t unscaled;
-    while(true)
-    {
-        unscaled = GetUnscaledCode(&stats);
-        if((c = GetSymbolFromProbability(unscaled, &stats)) == -1
-            || c == EOF_CHAR)
-            break;
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
 
-        fputc((char)c, outFile);
-        ApplySymbolRange(c, &stats);
-        ReadEncodedBits(bInFile, &stats);
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    while((len = SourceRead(source, &symbols, block)) != 0)
+    {
+        for(size_t i = 0; i < len; i++)
+            RangeEncodeStatic(&coder, bOutFile, &model, symbols[i]);
     }
-    inFile = BitFileToFILE(bInFile);
+
+    RangeEncodeStatic(&coder, bOutFile, &model, EOF_CHAR);
+    RangeEncoderFlush(&coder, bOutFile);
     return 0;
 }
 
-static int ReadHeader(bit_file_t* bfpIn, stats_t* stats)
+/*
+* Codes the bytes up to the raster with a model of their own, then each
+* pixel with the model of its context. Without a width in the options the
+* raster is found from a PGM header at the start of the input, anything
+* else is coded like the header.
+*/
+static int EncodeImage(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options)
 {
-    stats->cumulativeProb = 0;
-    int c;
-    for(c = 0; c <= UPPER(EOF_CHAR); c++)
-        stats->ranges[UPPER(c)] = 0;
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len = SourceRead(source, &symbols, block);
 
-    probability_t count;
-    while(true)
+    size_t offset;
+    unsigned int width = FindRaster(symbols, len, options, &offset);
+    BitFileWriteBits(bOutFile, width, 32);
+    BitFileWriteBits(bOutFile, (uint32_t)offset, 32);
+
+    model_t models[IMAGE_CONTEXTS + 1];
+    for(int i = 0; i <= IMAGE_CONTEXTS; i++)
+        InitializeAdaptiveProbabilityRangeList(&models[i]);
+
+    raster_t raster;
+    if(InitRaster(&raster, width) != 0)
     {
-        c = BitFileGetChar(bfpIn);
-        count = 0;
-        if(count == 0)
-            break;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
+
+    size_t position = 0;
+    while(len != 0)
+    {
+        for(size_t i = 0; i < len; i++, position++)
+        {
+            if((position < offset) || (width == 0))
+            {
+                RangeEncode(&coder, bOutFile, &models[IMAGE_CONTEXTS], symbols[i]);
+                continue;
+            }
+
+            int prediction;
+            int context = PixelContext(&raster, &prediction);
+            RangeEncode(&coder, bOutFile, &models[context], (symbols[i] - prediction) & UCHAR_MAX);
+            RasterPush(&raster, symbols[i]);
+        }
+        len = SourceRead(source, &symbols, block);
+    }
 
-        stats->ranges[UPPER(c)] = count;
-        stats->cumulativeProb += count;
+    /* EOF_CHAR goes where the next byte would */
+    model_t* model = &models[IMAGE_CONTEXTS];
+    if((position >= offset) && (width != 0))
+    {
+        int prediction;
+        model = &models[PixelContext(&raster, &prediction)];
     }
-    SymbolCountToProbabilityRanges(stats);
+    RangeEncode(&coder, bOutFile, model, EOF_CHAR);
+    RangeEncoderFlush(&coder, bOutFile);
+    delete[] raster.above;
     return 0;
 }
 
-static void InitializeDecoder(bit_file_t* bfpIn, stats_t* stats)
+/*
+* Every byte of the input as a flag and 8 bits, with the contexts of a
+* raster from its first pixel when there is one.
+*/
+static int EncodeMix(symbol_source_t* source, bit_file_t* bOutFile, const ar_options_t* options)
 {
-    stats->code = 0;
-    for(int i = 0; i < (int)PRECISION; i++)
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len = SourceRead(source, &symbols, block);
+
+    size_t offset;
+    unsigned int width = FindRaster(symbols, len, options, &offset);
+    BitFileWriteBits(bOutFile, width, 32);
+    BitFileWriteBits(bOutFile, (uint32_t)offset, 32);
+
+    mix_model_t* model = NewMixModel();
+    raster_t raster;
+    if((model == nullptr) || (InitRaster(&raster, width) != 0))
     {
-        stats->code <<= 1;
-        if(BitFileGetBit(bfpIn) == 1)
-            stats->code |= 1;
+        DeleteMixModel(model);
+        errno = ENOMEM;
+        return -1;
     }
-    stats->lower = 0;
-    stats->upper = ~0;
+
+    range_coder_t coder;
+    RangeEncoderInit(&coder);
+
+    size_t position = 0;
+    while(len != 0)
+    {
+        for(size_t i = 0; i < len; i++, position++)
+        {
+            RangeEncodeBit(&coder, bOutFile, MixMoreProbability(model), 1);
+            MixAdapt(&model->more, 1, model->rates);
+
+            bool pixel = (position >= offset) && (width != 0);
+            MixSelectContexts(model, &raster, pixel);
+            unsigned int partial = 1;
+            for(int b = 7; b >= 0; b--)
+            {
+                int bit = (symbols[i] >> b) & 1;
+                RangeEncodeBit(&coder, bOutFile, MixPredict(model, partial), bit);
+                MixUpdate(model, bit);
+                partial = (partial << 1) | bit;
+            }
+
+            model->history = (model->history << 8) | symbols[i];
+            if(pixel)
+                RasterPush(&raster, symbols[i]);
+        }
+        len = SourceRead(source, &symbols, block);
+    }
+
+    RangeEncodeBit(&coder, bOutFile, MixMoreProbability(model), 0);
+    RangeEncoderFlush(&coder, bOutFile);
+    DeleteMixModel(model);
+    delete[] raster.above;
+    return 0;
 }
 
-static probability_t GetUnscaledCode(stats_t* stats)
+/*
+* The raster width from the options or a PGM header at the start of the
+* input, and the offset of its first pixel. 0 when there is no raster.
+*/
+static unsigned int FindRaster(const unsigned char* symbols, size_t len, const ar_options_t* options, size_t* offset)
 {
-    unsigned long range = (unsigned long)(stats->upper - stats->lower) + 1;
-    unsigned long unscaled = (unsigned long)(stats->code - stats->lower) + 1;
-    unscaled = unscaled * (unsigned long)(stats->cumulativeProb) - 1;
-    unscaled /= range;
-    return ((probability_t)unscaled);
+    unsigned int width = options->width;
+    *offset = 0;
+    if((width == 0) && (ParsePgmHeader(symbols, len, &width, offset) != 0))
+        width = 0;
+    if(width > MAX_IMAGE_WIDTH)
+        width = 0;
+    return width;
 }
 
-static int GetSymbolFromProbability(probability_t probability, stats_t* stats)
+/*
+* Finds the width of an 8 bit P5 raster and the offset of its first pixel:
+* the magic, width, height and maximum value separated by white space and
+* comments, then a single white space character.
+*/
+static int ParsePgmHeader(const unsigned char* data, size_t len, unsigned int* width, size_t* offset)
 {
-    int first = 0;
-    int last = UPPER(EOF_CHAR);
-    int middle = last / 2;
+    if((len < 2) || (data[0] != 'P') || (data[1] != '5'))
+        return -1;
 
-    while(last >= first)
+    unsigned long values[3];
+    size_t i = 2;
+    for(int v = 0; v < 3; v++)
     {
-        if(probability < stats->ranges[LOWER(middle)])
+        while(i < len)
         {
-            last = middle - 1;
-            middle = first + ((last - first) / 2);
-            continue;
+            if(data[i] == '#')
+            {
+                while((i < len) && (data[i] != '\n'))
+                    i++;
+            }
+            else if((data[i] == ' ') || (data[i] == '\t') || (data[i] == '\r') || (data[i] == '\n'))
+            {
+                i++;
+            }
+            else
+            {
+                break;
+            }
         }
-        if(probability >= stats->ranges[UPPER(middle)])
+
+        if((i == len) || (data[i] < '0') || (data[i] > '9'))
+            return -1;
+
+        values[v] = 0;
+        while((i < len) && (data[i] >= '0') && (data[i] <= '9'))
         {
-            first = middle + 1;
-            middle = first + ((last - first) / 2);
-            continue;
+            if(values[v] > MAX_IMAGE_WIDTH)
+                return -1;
+            values[v] = values[v] * 10 + (data[i++] - '0');
         }
-        return middle;
     }
-    fprintf(stderr, "Unknown Symbol: %d (max: %d)\n", probability, stats->ranges[UPPER(EOF_CHAR)]);
-    return -1;
+
+    if((i == len) || (values[0] == 0) || (values[2] == 0) || (values[2] > UCHAR_MAX))
+        return -1;
+
+    *width = (unsigned int)values[0];
+    *offset = i + 1;
+    return 0;
 }
 
-static void ReadEncodedBits(bit_file_t* bfpIn, stats_t* stats)
+/* the counts below every symbol, from counts that add up to STATIC_TOTAL */
+static void SymbolCountToProbabilityRanges(static_model_t* model)
 {
-    int nextBit;
-    while(true)
+    unsigned int below = 0;
+    for(int c = 0; c <= EOF_CHAR; c++)
     {
-        if((stats->upper & MASK_BIT(0)) == (stats->lower & MASK_BIT(0)))
-        {
+        model->below[c] = below;
+        below += model->counts[c];
+    }
+}
 
-        }
+/*
+* Counts the symbols of the whole input and leaves the source back at its
+* start. Every symbol seen and EOF_CHAR keep a count of at least 1, the
+* rounding left over goes to the most frequent symbol.
+*/
+static int BuildProbabilityRangeList(symbol_source_t* source, static_model_t* model)
+{
+    long start = 0;
+    if((source->fp != nullptr) && ((start = ftell(source->fp)) < 0))
+        return -1;
+
+    const unsigned char* data = source->data;
+    size_t size = source->size;
+
+    uint64_t countArray[EOF_CHAR + 1];
+    for(int c = 0; c < EOF_CHAR; c++)
+        countArray[c] = 0;
+    countArray[EOF_CHAR] = 1;
+
+    unsigned char block[IO_BLOCK_SIZE];
+    const unsigned char* symbols;
+    size_t len;
+    uint64_t totalCount = 1;
+    while((len = SourceRead(source, &symbols, block)) != 0)
+    {
+        for(size_t i = 0; i < len; i++)
+            countArray[symbols[i]]++;
+        totalCount += len;
+    }
+
+    if(source->fp != nullptr)
+    {
+        if(fseek(source->fp, start, SEEK_SET) != 0)
+            return -1;
+    }
+    else
+    {
+        source->data = data;
+        source->size = size;
+    }
+
+    unsigned int sum = 0;
+    int largest = 0;
+    for(int c = 0; c <= EOF_CHAR; c++)
+    {
+        model->counts[c] = 0;
+        if(countArray[c] == 0)
+            continue;
+
+        /* the product stays below 2^64 for inputs up to 2^50 bytes */
+        model->counts[c] = (unsigned int)((countArray[c] * STATIC_TOTAL + totalCount / 2) / totalCount);
+        if(model->counts[c] == 0)
+            model->counts[c] = 1;
+        sum += model->counts[c];
+        if(countArray[c] > countArray[largest])
+            largest = c;
+    }
+
+    if(sum < STATIC_TOTAL)
+        model->counts[largest] += STATIC_TOTAL - sum;
+
+    while(sum > STATIC_TOTAL)
+    {
+        /* only the counts raised to 1 push the sum over, so the largest count always has some to give */
+        largest = 0;
+        for(int c = 1; c <= EOF_CHAR; c++)
+        {
+            if(model->counts[c] > model->counts[largest])
+                largest = c;
+        }
+        model->counts[largest]--;
+        sum--;
+    }
+
+    SymbolCountToProbabilityRanges(model);
+    return 0;
+}
+
+/* the count of EOF_CHAR is left out, it is what the bytes leave of STATIC_TOTAL */
+static void WriteHeader(bit_file_t* bfpOut, const static_model_t* model)
+{
+    for(int c = 0; c < EOF_CHAR; c++)
+    {
+        if(model->counts[c] > 0)
+        {
+            BitFileWriteBits(bfpOut, c, 8);
+            BitFileWriteBits(bfpOut, model->counts[c], STATIC_SCALE_BITS);
+        }
+    }
+
+    BitFileWriteBits(bfpOut, 0, 8);
+    BitFileWriteBits(bfpOut, 0, STATIC_SCALE_BITS);
+}
+
+static void InitializeAdaptiveProbabilityRangeList(model_t* model)
+{
+    for(int c = 0; c <= EOF_CHAR; c++)
+        model->counts[c] = 1;
+
+    BuildCountTree(model);
+}
+
+/* rebuilds the tree from the counts in one pass, each node adds itself to its parent */
+static void BuildCountTree(model_t* model)
+{
+    model->tree[0] = 0;
+    for(int i = 1; i <= MODEL_SIZE; i++)
+        model->tree[i] = (i <= EOF_CHAR + 1) ? model->counts[i - 1] : 0;
+
+    for(int i = 1; i <= MODEL_SIZE; i++)
+    {
+        int parent = i + (i & -i);
+        if(parent <= MODEL_SIZE)
+            model->tree[parent] += model->tree[i];
+    }
+    model->total = model->tree[MODEL_SIZE];
+}
+
+static unsigned int CountsBelow(const model_t* model, int symbol)
+{
+    unsigned int sum = 0;
+    for(int i = symbol; i > 0; i -= i & -i)
+        sum += model->tree[i];
+    return sum;
+}
+
+/* counts of PRIOR_TOTAL in all shared out by the prior, at least 1 each */
+static void ApplyPrior(model_t* model, const dictionary_t* dictionary)
+{
+    for(int c = 0; c <= EOF_CHAR; c++)
+        model->counts[c] = 1 + dictionary->prior[c] * (PRIOR_TOTAL - (EOF_CHAR + 1)) / DICTIONARY_PRIOR_TOTAL;
+
+    BuildCountTree(model);
+}
+
+/* counts symbol once more, halving all counts when the total reaches limit */
+static void UpdateModel(model_t* model, int symbol, unsigned int increment, unsigned int limit)
+{
+    model->total += increment;
+    model->counts[symbol] += increment;
+    for(int i = symbol + 1; i <= MODEL_SIZE; i += i & -i)
+        model->tree[i] += increment;
+
+    if(model->total >= limit)
+    {
+        for(int c = 0; c <= EOF_CHAR; c++)
+        {
+            if(model->counts[c] <= 2)
+                model->counts[c] = 1;
+            else
+                model->counts[c] /= 2;
+        }
+        BuildCountTree(model);
+    }
+}
+
+static void ApplySymbolRange(int symbol, stats_t* stats)
+{
+    model_t* model = &stats->model;
+    unsigned int below = CountsBelow(model, symbol);
+    unsigned long range = (unsigned long)(stats->upper - stats->lower) + 1;
+    unsigned long rescaled = (unsigned long)(below + model->counts[symbol]) * range;
+    rescaled /= (unsigned long)(model->total);
+
+    stats->upper = stats->lower + (probability_t)rescaled - 1;
+
+    rescaled = (unsigned long)(below) * range;
+    rescaled /= (unsigned long)(model->total);
+
+    stats->lower = stats->lower + (probability_t)rescaled;
+    UpdateModel(model, symbol, 1, MAX_PROBABILITY);
+}
+
+static void WriteEncodedBits(bit_file_t* bfpOut, stats_t* stats)
+{
+    while(true)
+    {
+        if((stats->upper & MASK_BIT(0)) == (stats->lower & MASK_BIT(0)))
+        {
+            BitFilePutBit((stats->upper & MASK_BIT(0)) != 0, bfpOut);
+
+            while(stats->underflowBits > 0)
+            {
+                BitFilePutBit((stats->upper & MASK_BIT(0)) == 0, bfpOut);
+                stats->underflowBits--;
+            }
+        }
+        else if((stats->lower & MASK_BIT(1)) && !(stats->upper & MASK_BIT(1)))
+        {
+            stats->underflowBits += 1;
+            stats->lower &= ~(MASK_BIT(0) | MASK_BIT(1));
+            stats->upper |= MASK_BIT(1);
+        }
+        else
+        {
+            return;
+        }
+        stats->lower <<= 1;
+        stats->upper <<= 1;
+        stats->upper |= 1;
+    }
+}
+
+static void WriteRemaining(bit_file_t* bfpOut, stats_t* stats)
+{
+    BitFilePutBit((stats->lower & MASK_BIT(1)) != 0, bfpOut);
+    for(stats->underflowBits++; stats->underflowBits > 0; stats->underflowBits--)
+        BitFilePutBit((stats->lower & MASK_BIT(1)) == 0, bfpOut);
+}
+
+static void RangeEncoderInit(range_coder_t* coder)
+{
+    coder->low = 0;
+    coder->range = 0xFFFFFFFF;
+    coder->cache = 0;
+    coder->cacheSize = 1;
+}
+
+static void RangeEncode(range_coder_t* coder, bit_file_t* bfpOut, model_t* model, int symbol)
+{
+    uint32_t r = coder->range / model->total;
+    coder->low += (uint64_t)r * CountsBelow(model, symbol);
+    coder->range = r * model->counts[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->range <<= 8;
+        RangeShiftLow(coder, bfpOut);
+    }
+    UpdateModel(model, symbol, RANGE_INCREMENT, RANGE_LIMIT);
+}
+
+/*
+* Moves the top byte of low out. A byte that may still take a carry is held
+* in cache, with the 0xFF bytes after it counted in cacheSize, until a later
+* byte shows whether the carry came.
+*/
+static void RangeShiftLow(range_coder_t* coder, bit_file_t* bfpOut)
+{
+    if(((uint32_t)coder->low < 0xFF000000) || ((coder->low >> 32) != 0))
+    {
+        uint32_t carry = (uint32_t)(coder->low >> 32);
+        uint32_t byte = coder->cache;
+        do
+        {
+            BitFileWriteBits(bfpOut, (byte + carry) & 0xFF, 8);
+            byte = 0xFF;
+        } while(--coder->cacheSize != 0);
+        coder->cache = (uint32_t)(coder->low >> 24) & 0xFF;
+    }
+    coder->cacheSize++;
+    coder->low = (coder->low & 0x00FFFFFF) << 8;
+}
+
+static void RangeEncoderFlush(range_coder_t* coder, bit_file_t* bfpOut)
+{
+    for(int i = 0; i < RANGE_FLUSH_BYTES; i++)
+        RangeShiftLow(coder, bfpOut);
+}
+
+int ArDecodeFile(FILE* inFile, FILE* outFile, const ar_options_t* options)
+{
+    if(nullptr == outFile)
+        outFile = stdout;
+
+    if(nullptr == inFile)
+    {
+        fprintf(stderr, "Error: Invalid input file\n");
+        return -1;
+    }
+
+    bit_file_t* bInFile = MakeBitFile(inFile, BF_READ);
+
+    if(nullptr == bInFile)
+    {
+        fprintf(stderr, "Error: Unable to create binary input file\n");
+        return -1;
+    }
+
+    symbol_sink_t sink;
+    InitSink(&sink, outFile, nullptr, 0);
+    DECODE_STATUS status = DecodeInput(bInFile, &sink, options);
+    inFile = BitFileToFILE(bInFile);
+
+    switch(status)
+    {
+    case DECODE_OK:
+        return 0;
+    case DECODE_BAD_FORMAT:
+        fprintf(stderr, "Error: Unknown stream format\n");
+        break;
+    case DECODE_NO_DICTIONARY:
+        fprintf(stderr, "Error: Stream was coded with a dictionary that was not given\n");
+        break;
+    case DECODE_NO_MEMORY:
+        fprintf(stderr, "Error: Out of memory\n");
+        errno = ENOMEM;
+        return -1;
+    default:
+        fprintf(stderr, "Error: Unknown symbol in coded stream\n");
+        break;
+    }
+    errno = EILSEQ;
+    return -1;
+}
+
+/* options give the threads and the dictionary, nullptr - neither */
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink, const ar_options_t* options)
+{
+    uint32_t header = BitFilePeekBits(bInFile, 24);
+    if((BitFileBitsAvailable(bInFile) >= 24) && ((header >> 8) == ((AR_SIGNATURE << 8) | AR_SIGNATURE))
+        && ((header & AR_BLOCK_FLAG) != 0))
+    {
+        BitFileSkipBits(bInFile, 24);
+        return DecodeBlocks(bInFile, sink, header & ~AR_BLOCK_FLAG & 0xFF, options);
+    }
+
+    return DecodeStream(bInFile, sink, (options != nullptr) ? options->dictionary : nullptr);
+}
+
+/* a single stream in any format, without blocks, the dictionary is for streams that name one */
+static DECODE_STATUS DecodeStream(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary)
+{
+    if((BitFilePeekBits(bInFile, 16) != ((AR_SIGNATURE << 8) | AR_SIGNATURE)) || (BitFileBitsAvailable(bInFile) < 16))
+        return DecodeBitwise(bInFile, sink);
+
+    BitFileSkipBits(bInFile, 16);
+    int format = BitFileGetChar(bInFile);
+    if((format != EOF) && ((format & AR_DICTIONARY_FLAG) != 0))
+    {
+        format &= ~AR_DICTIONARY_FLAG;
+        uint32_t id = BitFilePeekBits(bInFile, 32);
+        if((BitFileBitsAvailable(bInFile) < 32)
+            || ((format != AR_FORMAT_RANGE) && (format != AR_FORMAT_SHIFT) && (format != AR_FORMAT_TREE)))
+        {
+            return DECODE_BAD_FORMAT;
+        }
+        BitFileSkipBits(bInFile, 32);
+
+        if((dictionary == nullptr) || (dictionary->id != id))
+            return DECODE_NO_DICTIONARY;
+    }
+    else
+    {
+        dictionary = nullptr;
+    }
+
+    switch(format)
+    {
+    case AR_FORMAT_RANGE:
+        return DecodeRange(bInFile, sink, dictionary);
+    case AR_FORMAT_STATIC:
+        return DecodeStatic(bInFile, sink);
+    case AR_FORMAT_IMAGE:
+        return DecodeImage(bInFile, sink);
+    case AR_FORMAT_SHIFT:
+        return DecodeShift(bInFile, sink, dictionary);
+    case AR_FORMAT_MIX:
+        return DecodeMix(bInFile, sink);
+    case AR_FORMAT_TREE:
+        return DecodeTree(bInFile, sink, dictionary);
+    default:
+        return DECODE_BAD_FORMAT;
+    }
+}
+
+/*
+* Blocks are read BLOCK_BATCH at a time, decoded on the thread pool and
+* written in order.
+*/
+static DECODE_STATUS DecodeBlocks(bit_file_t* bInFile, symbol_sink_t* sink, int format, const ar_options_t* options)
+{
+    const dictionary_t* dictionary = (options != nullptr) ? options->dictionary : nullptr;
+    unsigned int numThreads = (options != nullptr) ? options->numThreads : 0;
+
+    size_t blockSize = BitFilePeekBits(bInFile, 32);
+    BitFileSkipBits(bInFile, 32);
+    size_t numSymbols = BitFilePeekBits(bInFile, 32);
+    if((BitFileBitsAvailable(bInFile) < 32) || (format >= AR_NO_FORMAT) || (format == AR_FORMAT_IMAGE)
+        || (blockSize < MIN_BLOCK_SIZE) || (blockSize > MAX_BLOCK_SIZE))
+    {
+        return DECODE_BAD_FORMAT;
+    }
+    BitFileSkipBits(bInFile, 32);
+
+    int numBlocks = (int)((numSymbols + blockSize - 1) / blockSize);
+    if(sink->fp == nullptr)
+        return DecodeBlockBuffer(bInFile, sink, dictionary, blockSize, numSymbols, numBlocks);
+
+    /* with room for a dictionary id, whether or not the blocks name one */
+    ar_options_t blockOptions;
+    ArDefaultOptions(&blockOptions);
+    blockOptions.format = (AR_FORMATS)format;
+    size_t blockBound = ArEncodeBound(blockSize, &blockOptions) + 1 + sizeof(uint32_t);
+
+    uint32_t* codedSizes = new (std::nothrow) uint32_t[numBlocks + 1];
+    if(codedSizes == nullptr)
+        return DECODE_NO_MEMORY;
+
+    bool valid = true;
+    for(int i = 0; valid && (i < numBlocks); i++)
+    {
+        codedSizes[i] = BitFilePeekBits(bInFile, 32);
+        valid = (BitFileBitsAvailable(bInFile) >= 32) && (codedSizes[i] <= blockBound);
+        BitFileSkipBits(bInFile, 32);
+    }
+
+    if(!valid)
+    {
+        delete[] codedSizes;
+        return DECODE_BAD_STREAM;
+    }
+
+    size_t codedCapacity = 0;
+    unsigned char* coded = nullptr;
+    /* a batch never holds more than the stream has, whatever block size the header gives */
+    unsigned char* decoded = new (std::nothrow) unsigned char[(size_t)((numBlocks < BLOCK_BATCH) ? numBlocks : BLOCK_BATCH) *
+        ((numSymbols < blockSize) ? numSymbols : blockSize)];
+    if(decoded == nullptr)
+    {
+        delete[] codedSizes;
+        return DECODE_NO_MEMORY;
+    }
+    size_t codedOffsets[BLOCK_BATCH + 1];
+    size_t blockLens[BLOCK_BATCH];
+    int blockStatus[BLOCK_BATCH];
+
+    block_decode_job_t job = { nullptr, codedOffsets, decoded, blockSize, blockLens, dictionary, blockStatus };
+
+    DECODE_STATUS status = DECODE_OK;
+    for(int first = 0; (first < numBlocks) && (status == DECODE_OK); first += BLOCK_BATCH)
+    {
+        int batch = (numBlocks - first < BLOCK_BATCH) ? numBlocks - first : BLOCK_BATCH;
+        size_t decodedSize = 0;
+        codedOffsets[0] = 0;
+        for(int i = 0; i < batch; i++)
+        {
+            codedOffsets[i + 1] = codedOffsets[i] + codedSizes[first + i];
+            blockLens[i] = numSymbols - (size_t)(first + i) * blockSize;
+            if(blockLens[i] > blockSize)
+                blockLens[i] = blockSize;
+            decodedSize += blockLens[i];
+        }
+
+        /* the bound of a block may be many times its size, so only what the batch takes is held */
+        if(codedOffsets[batch] > codedCapacity)
+        {
+            delete[] coded;
+            codedCapacity = codedOffsets[batch];
+            coded = new (std::nothrow) unsigned char[codedCapacity];
+            job.coded = coded;
+            if(coded == nullptr)
+            {
+                status = DECODE_NO_MEMORY;
+                break;
+            }
+        }
+
+        if(BitFileGetBytes(bInFile, coded, codedOffsets[batch]) != codedOffsets[batch])
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
+
+        ParallelFor(batch, numThreads, DecodeBlockJob, &job);
+
+        for(int i = 0; i < batch; i++)
+        {
+            if(blockStatus[i] != DECODE_OK)
+                status = (DECODE_STATUS)blockStatus[i];
+        }
+
+        if(status == DECODE_OK)
+            status = (SinkWrite(sink, decoded, decodedSize) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    }
+
+    delete[] coded;
+    delete[] decoded;
+    delete[] codedSizes;
+    return status;
+}
+
+/* the blocks of a block stream in memory, decoded in place one after another on the calling thread */
+static DECODE_STATUS DecodeBlockBuffer(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary, size_t blockSize, size_t numSymbols,
+    int numBlocks)
+{
+    size_t indexSize = (size_t)numBlocks * 4;
+    unsigned char* index = BitFileBufferBytes(bInFile, indexSize);
+    if(index == nullptr)
+        return DECODE_BAD_STREAM;
+
+    bit_file_t bIndex;
+    InitBitBuffer(&bIndex, index, indexSize, BF_READ);
+    for(int i = 0; i < numBlocks; i++)
+    {
+        size_t codedSize = BitFilePeekBits(&bIndex, 32);
+        BitFileSkipBits(&bIndex, 32);
+        size_t blockLen = numSymbols - (size_t)i * blockSize;
+        if(blockLen > blockSize)
+            blockLen = blockSize;
+
+        unsigned char* coded = BitFileBufferBytes(bInFile, codedSize);
+        if(coded == nullptr)
+            return DECODE_BAD_STREAM;
+
+        if(blockLen > sink->size - sink->len)
+            return DECODE_NO_ROOM;
+
+        DECODE_STATUS status = DecodeBlock(coded, codedSize, sink->buffer + sink->len, blockLen, dictionary);
+        if(status != DECODE_OK)
+            return status;
+        sink->len += blockLen;
+    }
+    return DECODE_OK;
+}
+
+static void DecodeBlockJob(void* context, int index)
+{
+    block_decode_job_t* job = (block_decode_job_t*)context;
+    job->status[index] = DecodeBlock(job->coded + job->codedOffsets[index],
+        job->codedOffsets[index + 1] - job->codedOffsets[index], job->decoded + (size_t)index * job->blockSize,
+        job->blockLens[index], job->dictionary);
+}
+
+/* one block into exactly blockLen symbols at block */
+static DECODE_STATUS DecodeBlock(unsigned char* coded, size_t codedSize, unsigned char* block, size_t blockLen,
+    const dictionary_t* dictionary)
+{
+    bit_file_t bfp;
+    InitBitBuffer(&bfp, coded, codedSize, BF_READ);
+    symbol_sink_t blockSink;
+    InitSink(&blockSink, nullptr, block, blockLen);
+
+    DECODE_STATUS status = DecodeStream(&bfp, &blockSink, dictionary);
+    if(status == DECODE_NO_ROOM)
+        return DECODE_BAD_STREAM;
+    if((status == DECODE_OK) && (blockSink.len != blockLen))
+        return DECODE_BAD_STREAM;
+    return status;
+}
+
+static DECODE_STATUS DecodeBitwise(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    stats_t stats;
+    InitializeAdaptiveProbabilityRangeList(&stats.model);
+    InitializeDecoder(bInFile, &stats);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    while(true)
+    {
+        unsigned int below;
+        int c = GetSymbolFromProbability(GetUnscaledCode(&stats), &stats.model, &below);
+        if(c == -1)
+        {
+            SinkWrite(sink, block, len);
+            return DECODE_BAD_STREAM;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len++] = (unsigned char)c;
+        if(len == IO_BLOCK_SIZE)
+        {
+            /* a damaged stream may never reach EOF_CHAR, a buffer then runs out of room */
+            if(SinkWrite(sink, block, len) != 0)
+                return DECODE_NO_ROOM;
+            len = 0;
+        }
+
+        ApplySymbolRange(c, &stats);
+        ReadEncodedBits(bInFile, &stats);
+    }
+    return (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+static DECODE_STATUS DecodeRange(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary)
+{
+    model_t model;
+    InitializeAdaptiveProbabilityRangeList(&model);
+    if(dictionary != nullptr)
+        ApplyPrior(&model, dictionary);
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    while(true)
+    {
+        int c = RangeDecode(&coder, bInFile, &model);
+        if((c == -1) || (coder.overrun != 0))
+        {
+            SinkWrite(sink, block, len);
+            return DECODE_BAD_STREAM;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len++] = (unsigned char)c;
+        if(len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+                return DECODE_NO_ROOM;
+            len = 0;
+        }
+    }
+    return (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+static DECODE_STATUS DecodeShift(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary)
+{
+    shift_model_t model;
+    InitShiftModel(&model, dictionary);
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    while(true)
+    {
+        int c = RangeDecodeShift(&coder, bInFile, &model);
+        if((c == -1) || (coder.overrun != 0))
+        {
+            SinkWrite(sink, block, len);
+            return DECODE_BAD_STREAM;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len++] = (unsigned char)c;
+        if(len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+                return DECODE_NO_ROOM;
+            len = 0;
+        }
+    }
+    return (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+static DECODE_STATUS DecodeStatic(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    static_model_t model;
+    if(ReadHeader(bInFile, &model) != 0)
+        return DECODE_BAD_STREAM;
+
+    unsigned short lookup[STATIC_TOTAL];
+    for(int c = 0; c <= EOF_CHAR; c++)
+    {
+        for(unsigned int i = 0; i < model.counts[c]; i++)
+            lookup[model.below[c] + i] = (unsigned short)c;
+    }
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    while(true)
+    {
+        int c = RangeDecodeStatic(&coder, bInFile, &model, lookup);
+        if((c == -1) || (coder.overrun != 0))
+        {
+            SinkWrite(sink, block, len);
+            return DECODE_BAD_STREAM;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len++] = (unsigned char)c;
+        if(len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+                return DECODE_NO_ROOM;
+            len = 0;
+        }
+    }
+    return (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+static DECODE_STATUS DecodeImage(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    unsigned int width = BitFilePeekBits(bInFile, 32);
+    BitFileSkipBits(bInFile, 32);
+    size_t offset = BitFilePeekBits(bInFile, 32);
+    BitFileSkipBits(bInFile, 32);
+    if(width > MAX_IMAGE_WIDTH)
+        return DECODE_BAD_STREAM;
+
+    model_t models[IMAGE_CONTEXTS + 1];
+    for(int i = 0; i <= IMAGE_CONTEXTS; i++)
+        InitializeAdaptiveProbabilityRangeList(&models[i]);
+
+    raster_t raster;
+    if(InitRaster(&raster, width) != 0)
+        return DECODE_NO_MEMORY;
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    DECODE_STATUS status = DECODE_OK;
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    for(size_t position = 0; ; position++)
+    {
+        int prediction = 0;
+        bool pixel = (position >= offset) && (width != 0);
+        int c = RangeDecode(&coder, bInFile, &models[pixel ? PixelContext(&raster, &prediction) : IMAGE_CONTEXTS]);
+        if((c == -1) || (coder.overrun != 0))
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len] = (unsigned char)(c + prediction);
+        if(pixel)
+            RasterPush(&raster, block[len]);
+
+        if(++len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+            {
+                delete[] raster.above;
+                return DECODE_NO_ROOM;
+            }
+            len = 0;
+        }
+    }
+    delete[] raster.above;
+
+    DECODE_STATUS written = (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    return (status != DECODE_OK) ? status : written;
+}
+
+static DECODE_STATUS DecodeMix(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    unsigned int width = BitFilePeekBits(bInFile, 32);
+    BitFileSkipBits(bInFile, 32);
+    size_t offset = BitFilePeekBits(bInFile, 32);
+    BitFileSkipBits(bInFile, 32);
+    if(width > MAX_IMAGE_WIDTH)
+        return DECODE_BAD_STREAM;
+
+    mix_model_t* model = NewMixModel();
+    raster_t raster;
+    if((model == nullptr) || (InitRaster(&raster, width) != 0))
+    {
+        DeleteMixModel(model);
+        return DECODE_NO_MEMORY;
+    }
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    DECODE_STATUS status = DECODE_OK;
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    for(size_t position = 0; ; position++)
+    {
+        int more = RangeDecodeBit(&coder, bInFile, MixMoreProbability(model));
+        if(coder.overrun != 0)
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
+        else if(more == 0)
+        {
+            break;
+        }
+        MixAdapt(&model->more, 1, model->rates);
+
+        bool pixel = (position >= offset) && (width != 0);
+        MixSelectContexts(model, &raster, pixel);
+        unsigned int partial = 1;
+        while(partial < 0x100)
+        {
+            int bit = RangeDecodeBit(&coder, bInFile, MixPredict(model, partial));
+            MixUpdate(model, bit);
+            partial = (partial << 1) | bit;
+        }
+
+        block[len] = (unsigned char)partial;
+        model->history = (model->history << 8) | block[len];
+        if(pixel)
+            RasterPush(&raster, block[len]);
+
+        if(++len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+            {
+                status = DECODE_NO_ROOM;
+                len = 0;
+                break;
+            }
+            len = 0;
+        }
+    }
+    DeleteMixModel(model);
+    delete[] raster.above;
+
+    DECODE_STATUS written = (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    return (status != DECODE_OK) ? status : written;
+}
+
+static DECODE_STATUS DecodeTree(bit_file_t* bInFile, symbol_sink_t* sink, const dictionary_t* dictionary)
+{
+    unsigned short tree[MODEL_SIZE];
+    InitTree(tree, dictionary);
+
+    range_coder_t coder;
+    RangeDecoderInit(&coder, bInFile);
+
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t len = 0;
+    while(true)
+    {
+        int c = RangeDecodeTree(&coder, bInFile, tree);
+        if((c == -1) || (coder.overrun != 0))
+        {
+            SinkWrite(sink, block, len);
+            return DECODE_BAD_STREAM;
+        }
+        else if(c == EOF_CHAR)
+        {
+            break;
+        }
+
+        block[len++] = (unsigned char)c;
+        if(len == IO_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, block, len) != 0)
+                return DECODE_NO_ROOM;
+            len = 0;
+        }
+    }
+    return (SinkWrite(sink, block, len) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+size_t ArEncodeBound(const size_t size, const ar_options_t* options)
+{
+    if((options != nullptr) && (options->blockSize != 0))
+    {
+        /* every block is a stream of its own with a size in the index and a pad byte */
+        ar_options_t streamOptions = *options;
+        streamOptions.blockSize = 0;
+        size_t numBlocks = (size + options->blockSize - 1) / options->blockSize;
+        size_t bound = AR_BLOCK_HEADER_SIZE + numBlocks * 5
+            + (size / options->blockSize) * ArEncodeBound(options->blockSize, &streamOptions);
+        if(size % options->blockSize != 0)
+            bound += ArEncodeBound(size % options->blockSize, &streamOptions);
+        return bound;
+    }
+
+    if((options == nullptr) || (options->format == AR_FORMAT_BITWISE))
+    {
+        /* a symbol gets at least one unit of a range kept above a quarter, so costs at most 15 bits */
+        return 2 * (size + 2);
+    }
+
+    /* only the formats that take a dictionary carry its id */
+    size_t idSize = (options->dictionary != nullptr) ? sizeof(uint32_t) : 0;
+    if(options->format == AR_FORMAT_TREE)
+    {
+        /* 9 decisions of at least 31 4096ths of the range, so under 64 bits */
+        return 8 * (size + 1) + AR_HEADER_SIZE + idSize + RANGE_FLUSH_BYTES;
+    }
+
+    if(options->format == AR_FORMAT_MIX)
+    {
+        /* a flag and 8 bits, each at least a 4096th of the range less a 4096th, so 12 bits and a little */
+        return 14 * (size + 1) + AR_HEADER_SIZE + IMAGE_HEADER_SIZE + RANGE_FLUSH_BYTES;
+    }
+
+    /*
+    * a symbol gets at least one RANGE_LIMIT-th of the range, less what the
+    * division drops, so costs at most 16 bits and a 256th
+    */
+    size_t bound = 2 * (size + 1) + size / 128 + AR_HEADER_SIZE + idSize + RANGE_FLUSH_BYTES;
+    if(options->format == AR_FORMAT_STATIC)
+        bound += STATIC_HEADER_SIZE;
+    else if(options->format == AR_FORMAT_IMAGE)
+        bound += IMAGE_HEADER_SIZE;
+    return bound;
+}
+
+int ArEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ar_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    ar_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        ArDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    if(CheckOptions(options) != 0)
+        return -1;
+
+    bit_file_t bOutFile;
+    InitBitBuffer(&bOutFile, dst, capacity, BF_WRITE);
+
+    symbol_source_t source = { nullptr, src, size };
+    if(EncodeInput(&source, &bOutFile, options) != 0)
+        return -1;
+    size_t used = CloseBitBuffer(&bOutFile);
+    if(bOutFile.error)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    *dstSize = used;
+    return 0;
+}
+
+int ArDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ar_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    bit_file_t bInFile;
+    InitBitBuffer(&bInFile, (unsigned char*)src, size, BF_READ);
+    symbol_sink_t sink;
+    InitSink(&sink, nullptr, dst, capacity);
+
+    DECODE_STATUS status = DecodeInput(&bInFile, &sink, options);
+    if(status != DECODE_OK)
+    {
+        errno = (status == DECODE_NO_ROOM) ? ENOSPC : (status == DECODE_NO_MEMORY) ? ENOMEM : EILSEQ;
+        return -1;
+    }
+
+    *dstSize = sink.len;
+    return 0;
+}
+
+/* -1 when a symbol comes twice or the bytes leave no count for EOF_CHAR */
+static int ReadHeader(bit_file_t* bfpIn, static_model_t* model)
+{
+    for(int c = 0; c <= EOF_CHAR; c++)
+        model->counts[c] = 0;
+
+    unsigned int total = 0;
+    while(true)
+    {
+        int c = BitFilePeekBits(bfpIn, 8);
+        BitFileSkipBits(bfpIn, 8);
+        unsigned int count = BitFilePeekBits(bfpIn, STATIC_SCALE_BITS);
+        BitFileSkipBits(bfpIn, STATIC_SCALE_BITS);
+        if(count == 0)
+            break;
+
+        if((model->counts[c] != 0) || (count >= STATIC_TOTAL - total))
+            return -1;
+
+        model->counts[c] = count;
+        total += count;
+    }
+
+    model->counts[EOF_CHAR] = STATIC_TOTAL - total;
+    SymbolCountToProbabilityRanges(model);
+    return 0;
+}
+
+static void InitializeDecoder(bit_file_t* bfpIn, stats_t* stats)
+{
+    stats->code = 0;
+    for(int i = 0; i < (int)PRECISION; i++)
+    {
+        stats->code <<= 1;
+        if(BitFileGetBit(bfpIn) == 1)
+            stats->code |= 1;
+    }
+    stats->lower = 0;
+    stats->upper = ~0;
+}
+
+static probability_t GetUnscaledCode(stats_t* stats)
+{
+    unsigned long range = (unsigned long)(stats->upper - stats->lower) + 1;
+    unsigned long unscaled = (unsigned long)(stats->code - stats->lower) + 1;
+    unscaled = unscaled * (unsigned long)(stats->model.total) - 1;
+    unscaled /= range;
+    return ((probability_t)unscaled);
+}
+
+static int GetSymbolFromProbability(unsigned int probability, const model_t* model, unsigned int* below)
+{
+    /* walks down the tree to the last symbol whose counts below do not pass probability */
+    int symbol = 0;
+    unsigned int remaining = probability;
+    for(int step = MODEL_SIZE; step > 0; step >>= 1)
+    {
+        if((symbol + step <= MODEL_SIZE) && (model->tree[symbol + step] <= remaining))
+        {
+            symbol += step;
+            remaining -= model->tree[symbol];
+        }
+    }
+    *below = probability - remaining;
+    return (symbol <= EOF_CHAR) ? symbol : -1;
+}
+
+static void ReadEncodedBits(bit_file_t* bfpIn, stats_t* stats)
+{
+    int nextBit;
+    while(true)
+    {
+        if((stats->upper & MASK_BIT(0)) == (stats->lower & MASK_BIT(0)))
+        {
+
+        }
         else if((stats->lower & MASK_BIT(1)) && !(stats->upper & MASK_BIT(1)))
         {
             stats->lower &= ~(MASK_BIT(0) | MASK_BIT(1));
@@ -387,3 +2071,539 @@ static void ReadEncodedBits(bit_file_t* bfpIn, stats_t* stats)
             stats->code |= nextBit;
     }
 }
+
+/*
+* The next byte of a range coded stream, zeros past its end. The flush of
+* the encoder leaves every byte the decoder takes in the stream, so overrun
+* counts the reads that show it was cut short.
+*/
+static uint32_t RangeGetByte(range_coder_t* coder, bit_file_t* bfpIn)
+{
+    uint32_t byte = BitFilePeekBits(bfpIn, 8);
+    if(BitFileBitsAvailable(bfpIn) < 8)
+        coder->overrun++;
+    BitFileSkipBits(bfpIn, 8);
+    return byte;
+}
+
+static void RangeDecoderInit(range_coder_t* coder, bit_file_t* bfpIn)
+{
+    coder->code = 0;
+    coder->range = 0xFFFFFFFF;
+    coder->overrun = 0;
+    for(int i = 0; i < RANGE_FLUSH_BYTES; i++)
+        coder->code = (coder->code << 8) | RangeGetByte(coder, bfpIn);
+}
+
+static int RangeDecode(range_coder_t* coder, bit_file_t* bfpIn, model_t* model)
+{
+    uint32_t r = coder->range / model->total;
+    uint32_t value = coder->code / r;
+    if(value >= model->total)
+        return -1;
+
+    unsigned int below;
+    int symbol = GetSymbolFromProbability(value, model, &below);
+    coder->code -= r * below;
+    coder->range = r * model->counts[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->code = (coder->code << 8) | RangeGetByte(coder, bfpIn);
+        coder->range <<= 8;
+    }
+    UpdateModel(model, symbol, RANGE_INCREMENT, RANGE_LIMIT);
+    return symbol;
+}
+
+/* the static model needs no update, and its total is a power of two */
+static void RangeEncodeStatic(range_coder_t* coder, bit_file_t* bfpOut, const static_model_t* model, int symbol)
+{
+    uint32_t r = coder->range >> STATIC_SCALE_BITS;
+    coder->low += (uint64_t)r * model->below[symbol];
+    coder->range = r * model->counts[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->range <<= 8;
+        RangeShiftLow(coder, bfpOut);
+    }
+}
+
+static int RangeDecodeStatic(range_coder_t* coder, bit_file_t* bfpIn, const static_model_t* model,
+    const unsigned short* lookup)
+{
+    uint32_t r = coder->range >> STATIC_SCALE_BITS;
+    uint32_t value = coder->code / r;
+    if(value >= STATIC_TOTAL)
+        return -1;
+
+    int symbol = lookup[value];
+    coder->code -= r * model->below[symbol];
+    coder->range = r * model->counts[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->code = (coder->code << 8) | RangeGetByte(coder, bfpIn);
+        coder->range <<= 8;
+    }
+    return symbol;
+}
+
+/* counts from the prior of the dictionary as the range format has them, or 1 each without one */
+static void InitShiftModel(shift_model_t* model, const dictionary_t* dictionary)
+{
+    model->total = 0;
+    for(int c = 0; c <= EOF_CHAR; c++)
+    {
+        model->counts[c] = 1;
+        if(dictionary != nullptr)
+            model->counts[c] += dictionary->prior[c] * (PRIOR_TOTAL - (EOF_CHAR + 1)) / DICTIONARY_PRIOR_TOTAL;
+        model->total += model->counts[c];
+    }
+
+    /* past the last symbol so the decoder never steps beyond it */
+    for(int c = EOF_CHAR + 1; c < MODEL_SIZE; c++)
+        model->below[c] = SHIFT_TOTAL;
+
+    /* for a top part m of the range unit, 2^32 / (m + 1) */
+    const unsigned int first = 1u << (SHIFT_RECIPROCAL_BITS - 1);
+    for(unsigned int m = first; m < 2 * first; m++)
+        model->reciprocals[m - first] = (uint32_t)((1ull << 32) / (m + 1));
+
+    model->interval = SHIFT_FIRST_REBUILD;
+    RebuildShiftModel(model);
+}
+
+/*
+* Scales the counts to frequencies of at least 1 that add up to
+* SHIFT_TOTAL, the one division here is shared by all the symbols until
+* the next rebuild.
+*/
+static void RebuildShiftModel(shift_model_t* model)
+{
+    uint64_t scale = ((uint64_t)(SHIFT_TOTAL - (EOF_CHAR + 1)) << 32) / model->total;
+    unsigned int below = 0;
+    int largest = 0;
+    for(int c = 0; c <= EOF_CHAR; c++)
+    {
+        model->freqs[c] = 1 + (unsigned int)((model->counts[c] * scale) >> 32);
+        below += model->freqs[c];
+        if(model->counts[c] > model->counts[largest])
+            largest = c;
+    }
+    model->freqs[largest] += SHIFT_TOTAL - below;
+
+    below = 0;
+    for(int c = 0; c <= EOF_CHAR; c++)
+    {
+        model->below[c] = below;
+        below += model->freqs[c];
+    }
+
+    /* the symbol holding the first value of each part of the total */
+    int symbol = 0;
+    for(unsigned int i = 0; i < (1u << SHIFT_LOOKUP_BITS); i++)
+    {
+        unsigned int value = i << (SHIFT_SCALE_BITS - SHIFT_LOOKUP_BITS);
+        while(model->below[symbol + 1] <= value)
+            symbol++;
+        model->lookup[i] = (unsigned short)symbol;
+    }
+
+    if(model->total >= SHIFT_LIMIT)
+    {
+        model->total = 0;
+        for(int c = 0; c <= EOF_CHAR; c++)
+        {
+            model->counts[c] = (model->counts[c] <= 2) ? 1 : model->counts[c] / 2;
+            model->total += model->counts[c];
+        }
+    }
+
+    model->untilRebuild = model->interval;
+    if(model->interval < SHIFT_MAX_REBUILD)
+        model->interval *= 2;
+}
+
+static void RangeEncodeShift(range_coder_t* coder, bit_file_t* bfpOut, shift_model_t* model, int symbol)
+{
+    uint32_t r = coder->range >> SHIFT_SCALE_BITS;
+    coder->low += (uint64_t)r * model->below[symbol];
+    coder->range = r * model->freqs[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->range <<= 8;
+        RangeShiftLow(coder, bfpOut);
+    }
+
+    model->counts[symbol] += RANGE_INCREMENT;
+    model->total += RANGE_INCREMENT;
+    if(--model->untilRebuild == 0)
+        RebuildShiftModel(model);
+}
+
+static int RangeDecodeShift(range_coder_t* coder, bit_file_t* bfpIn, shift_model_t* model)
+{
+    uint32_t r = coder->range >> SHIFT_SCALE_BITS;
+    if(coder->code >= r * SHIFT_TOTAL)
+        return -1;
+
+    /* r is at least RANGE_TOP >> SHIFT_SCALE_BITS, shifting it down to its top bits takes three tests */
+    const unsigned int bits = SHIFT_RECIPROCAL_BITS;
+    unsigned int shift = (r >= (1u << (bits + 3))) ? 4 : 0;
+    shift += ((r >> shift) >= (1u << (bits + 1))) ? 2 : 0;
+    shift += ((r >> shift) >= (1u << bits)) ? 1 : 0;
+    uint32_t reciprocal = model->reciprocals[(r >> shift) - (1u << (bits - 1))];
+    unsigned int estimate = (unsigned int)(((uint64_t)coder->code * reciprocal) >> (32 + shift));
+
+    int symbol = model->lookup[estimate >> (SHIFT_SCALE_BITS - SHIFT_LOOKUP_BITS)];
+    while(r * model->below[symbol + 1] <= coder->code)
+        symbol++;
+
+    coder->code -= r * model->below[symbol];
+    coder->range = r * model->freqs[symbol];
+    while(coder->range < RANGE_TOP)
+    {
+        coder->code = (coder->code << 8) | RangeGetByte(coder, bfpIn);
+        coder->range <<= 8;
+    }
+
+    model->counts[symbol] += RANGE_INCREMENT;
+    model->total += RANGE_INCREMENT;
+    if(--model->untilRebuild == 0)
+        RebuildShiftModel(model);
+    return symbol;
+}
+
+/* probability is that of a 1 in BIT_PROBABILITY_BITS bits, from 1 to all but 1 */
+static void RangeEncodeBit(range_coder_t* coder, bit_file_t* bfpOut, unsigned int probability, int bit)
+{
+    uint32_t bound = (coder->range >> BIT_PROBABILITY_BITS) * probability;
+    if(bit)
+    {
+        coder->range = bound;
+    }
+    else
+    {
+        coder->low += bound;
+        coder->range -= bound;
+    }
+
+    while(coder->range < RANGE_TOP)
+    {
+        coder->range <<= 8;
+        RangeShiftLow(coder, bfpOut);
+    }
+}
+
+static int RangeDecodeBit(range_coder_t* coder, bit_file_t* bfpIn, unsigned int probability)
+{
+    uint32_t bound = (coder->range >> BIT_PROBABILITY_BITS) * probability;
+    int bit = (coder->code < bound);
+    if(bit)
+    {
+        coder->range = bound;
+    }
+    else
+    {
+        coder->code -= bound;
+        coder->range -= bound;
+    }
+
+    while(coder->range < RANGE_TOP)
+    {
+        coder->code = (coder->code << 8) | RangeGetByte(coder, bfpIn);
+        coder->range <<= 8;
+    }
+    return bit;
+}
+
+/*
+* Every probability at a half, or with a dictionary the share of its
+* prior below the 1 side of the node, kept as far from either end as
+* TreeAdapt keeps them.
+*/
+static void InitTree(unsigned short* tree, const dictionary_t* dictionary)
+{
+    for(int node = 0; node < MODEL_SIZE; node++)
+        tree[node] = 1 << (BIT_PROBABILITY_BITS - 1);
+    if(dictionary == nullptr)
+        return;
+
+    /* prior below every node, the leaves past EOF_CHAR have none */
+    unsigned int sums[2 * MODEL_SIZE];
+    for(int node = MODEL_SIZE; node < 2 * MODEL_SIZE; node++)
+        sums[node] = (node - MODEL_SIZE <= EOF_CHAR) ? dictionary->prior[node - MODEL_SIZE] : 0;
+
+    const unsigned int lowest = (1 << TREE_MOVE_BITS) - 1;
+    const unsigned int highest = (1 << BIT_PROBABILITY_BITS) - lowest;
+    for(int node = MODEL_SIZE - 1; node > 0; node--)
+    {
+        sums[node] = sums[2 * node] + sums[2 * node + 1];
+        if(sums[node] == 0)
+            continue;
+
+        unsigned int probability = (sums[2 * node + 1] << BIT_PROBABILITY_BITS) / sums[node];
+        tree[node] = (unsigned short)((probability < lowest) ? lowest : (probability > highest) ? highest : probability);
+    }
+}
+
+/* node 1 is the root, the children of node n are 2n and 2n + 1 */
+static void RangeEncodeTree(range_coder_t* coder, bit_file_t* bfpOut, unsigned short* tree, int symbol)
+{
+    unsigned int node = 1;
+    for(int b = 8; b >= 0; b--)
+    {
+        int bit = (symbol >> b) & 1;
+        RangeEncodeBit(coder, bfpOut, tree[node], bit);
+        TreeAdapt(&tree[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+/* -1 for a leaf past EOF_CHAR */
+static int RangeDecodeTree(range_coder_t* coder, bit_file_t* bfpIn, unsigned short* tree)
+{
+    unsigned int node = 1;
+    while(node < MODEL_SIZE)
+    {
+        int bit = RangeDecodeBit(coder, bfpIn, tree[node]);
+        TreeAdapt(&tree[node], bit);
+        node = (node << 1) | bit;
+    }
+
+    int symbol = node - MODEL_SIZE;
+    return (symbol <= EOF_CHAR) ? symbol : -1;
+}
+
+static void TreeAdapt(unsigned short* probability, int bit)
+{
+    if(bit)
+        *probability += ((1 << BIT_PROBABILITY_BITS) - *probability) >> TREE_MOVE_BITS;
+    else
+        *probability -= *probability >> TREE_MOVE_BITS;
+}
+
+/* every probability at a half and never seen, and the mixer weights sharing out 1, nullptr without memory for them */
+static mix_model_t* NewMixModel(void)
+{
+    mix_model_t* model = new (std::nothrow) mix_model_t;
+    if(model == nullptr)
+        return nullptr;
+    model->table = new (std::nothrow) uint32_t[MIX_TABLE_SIZE];
+    if(model->table == nullptr)
+    {
+        delete model;
+        return nullptr;
+    }
+
+    for(size_t i = 0; i < MIX_TABLE_SIZE; i++)
+        model->table[i] = 1u << 31;
+    model->more = 1u << 31;
+    model->history = 0;
+
+    for(int set = 0; set < MIX_WEIGHT_SETS; set++)
+    {
+        for(int i = 0; i < MIX_MODELS; i++)
+            model->weights[set][i] = (1 << 16) / MIX_MODELS;
+        model->weights[set][MIX_MODELS] = 0;
+    }
+
+    /* stretch is the inverse of Squash, ln(p / (1 - p)) in the same units */
+    int first = 0;
+    for(int x = -2047; x <= 2047; x++)
+    {
+        int p = Squash(x);
+        for(int i = first; i <= p; i++)
+            model->stretch[i] = (short)x;
+        first = p + 1;
+    }
+    for(int i = first; i < (1 << BIT_PROBABILITY_BITS); i++)
+        model->stretch[i] = 2047;
+
+    /* a probability seen n times moves about 1 / (n + 1.5) of the way to each bit */
+    for(int n = 0; n <= MIX_COUNT_LIMIT; n++)
+        model->rates[n] = 16384 / (n + n + 3);
+    return model;
+}
+
+static void DeleteMixModel(mix_model_t* model)
+{
+    if(model == nullptr)
+        return;
+    delete[] model->table;
+    delete model;
+}
+
+/* the table entries of every model for the next byte, and the mixer weights to use */
+static void MixSelectContexts(mix_model_t* model, const raster_t* raster, bool pixel)
+{
+    uint32_t history = model->history;
+    uint32_t hashed[MIX_MODELS - 2];
+    if(pixel)
+    {
+        int prediction;
+        int gradient = PixelContext(raster, &prediction);
+        int north = raster->firstRow ? raster->west : raster->above[raster->x];
+        int northEast = (!raster->firstRow && (raster->x + 1 < raster->width)) ? raster->above[raster->x + 1] : north;
+        hashed[0] = ((uint32_t)north << 8) | northEast;
+        hashed[1] = ((uint32_t)north << 8) | (history & 0xFF);
+        hashed[2] = ((uint32_t)gradient << 8) | prediction;
+        model->set = gradient;
+    }
+    else
+    {
+        hashed[0] = history & 0xFFFF;
+        hashed[1] = history & 0xFFFFFF;
+        hashed[2] = history;
+        model->set = (history & 0xFF) >> 5;
+    }
+
+    model->contexts[0] = 0;
+    model->contexts[1] = (1u << 8) + ((history & 0xFF) << 8);
+    uint32_t base = (1u << 8) + (1u << 16);
+    for(int i = 2; i < MIX_MODELS; i++)
+    {
+        /* the top bits of a multiplicative hash pick 256 entries for the bits of the byte */
+        uint32_t hash = (hashed[i - 2] + 1) * 0x9E3779B1u;
+        model->contexts[i] = base + ((hash >> (32 - (MIX_HASH_BITS - 8))) << 8);
+        base += 1u << MIX_HASH_BITS;
+    }
+}
+
+/* the mixed probability of a 1 for the next bit, partial is the bits of the byte so far after a 1 */
+static unsigned int MixPredict(mix_model_t* model, unsigned int partial)
+{
+    model->weightSet = model->weights[(model->set << 8) | partial];
+    int64_t dot = 0;
+    for(int i = 0; i < MIX_MODELS; i++)
+    {
+        model->slots[i] = &model->table[model->contexts[i] + partial];
+        model->stretched[i] = model->stretch[*model->slots[i] >> (32 - BIT_PROBABILITY_BITS)];
+        dot += (int64_t)model->weightSet[i] * model->stretched[i];
+    }
+    model->stretched[MIX_MODELS] = 256;
+    dot += (int64_t)model->weightSet[MIX_MODELS] * 256;
+
+    int p = Squash((int)(dot >> 16));
+    if(p < 1)
+        p = 1;
+    else if(p > (1 << BIT_PROBABILITY_BITS) - 1)
+        p = (1 << BIT_PROBABILITY_BITS) - 1;
+    model->mixed = p;
+    return p;
+}
+
+/* moves the weights along the error of the mixed probability, and every model toward the bit */
+static void MixUpdate(mix_model_t* model, int bit)
+{
+    int error = (bit << BIT_PROBABILITY_BITS) - model->mixed;
+    for(int i = 0; i < MIX_INPUTS; i++)
+        model->weightSet[i] += (model->stretched[i] * error) >> MIX_LEARNING_SHIFT;
+
+    for(int i = 0; i < MIX_MODELS; i++)
+        MixAdapt(model->slots[i], bit, model->rates);
+}
+
+static unsigned int MixMoreProbability(const mix_model_t* model)
+{
+    unsigned int p = model->more >> (32 - BIT_PROBABILITY_BITS);
+    if(p < 1)
+        return 1;
+    if(p > (1 << BIT_PROBABILITY_BITS) - 1)
+        return (1 << BIT_PROBABILITY_BITS) - 1;
+    return p;
+}
+
+static void MixAdapt(uint32_t* slot, int bit, const int* rates)
+{
+    unsigned int count = *slot & 1023;
+    int p = (int)(*slot >> 10);
+    if(count < MIX_COUNT_LIMIT)
+        (*slot)++;
+    *slot += (uint32_t)((((bit << 22) - p) >> 3) * rates[count]) & ~1023u;
+}
+
+/*
+* 4096 / (1 + e^-x) for x in units of 1/256, from points every 128 units
+* with straight lines between them.
+*/
+static int Squash(int stretched)
+{
+    static const int points[33] =
+    {
+        1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101, 1546,
+        2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4022, 4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094
+    };
+
+    if(stretched > 2047)
+        return 4095;
+    if(stretched < -2047)
+        return 1;
+
+    int x = stretched + 2048;
+    int w = x & 127;
+    return (points[x >> 7] * (128 - w) + points[(x >> 7) + 1] * w + 64) >> 7;
+}
+
+/* -1 when the row above can not be allocated */
+static int InitRaster(raster_t* raster, unsigned int width)
+{
+    raster->above = (width != 0) ? new (std::nothrow) unsigned char[width] : nullptr;
+    raster->width = width;
+    raster->x = 0;
+    raster->firstRow = true;
+    raster->west = 0;
+    raster->northWest = 0;
+    return ((width != 0) && (raster->above == nullptr)) ? -1 : 0;
+}
+
+/*
+* The model for the next pixel, from how much its neighbours differ, and
+* the median edge prediction of its value. Neighbours outside the raster
+* are replaced by the nearest one inside.
+*/
+static int PixelContext(const raster_t* raster, int* prediction)
+{
+    int w, n, nw, ne;
+    if(raster->firstRow)
+    {
+        w = raster->west;
+        n = nw = ne = w;
+    }
+    else
+    {
+        n = raster->above[raster->x];
+        w = (raster->x > 0) ? raster->west : n;
+        nw = (raster->x > 0) ? raster->northWest : n;
+        ne = (raster->x + 1 < raster->width) ? raster->above[raster->x + 1] : n;
+    }
+
+    int low = (w < n) ? w : n;
+    int high = (w < n) ? n : w;
+    if(nw >= high)
+        *prediction = low;
+    else if(nw <= low)
+        *prediction = high;
+    else
+        *prediction = w + n - nw;
+
+    unsigned int gradient = abs(w - nw) + abs(n - nw) + abs(ne - n);
+    int context = 0;
+    while((gradient != 0) && (context < IMAGE_CONTEXTS - 1))
+    {
+        gradient >>= 1;
+        context++;
+    }
+    return context;
+}
+
+static void RasterPush(raster_t* raster, unsigned char pixel)
+{
+    raster->northWest = raster->above[raster->x];
+    raster->above[raster->x] = pixel;
+    raster->west = pixel;
+    if(++raster->x == raster->width)
+    {
+        raster->x = 0;
+        raster->firstRow = false;
+    }
+}
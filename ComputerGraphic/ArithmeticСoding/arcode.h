@@ -1,7 +1,63 @@
 #ifndef _ARCODE_H_
 #define _ARCODE_H_
 
-int ArEncodeFile(FILE* inFile, FILE* outFile);
-int ArDecodeFile(FILE* inFile, FILE* outFile);
+#include "dictionary.h"
+
+typedef enum
+{
+    /* 16 bit interval moved a bit at a time, the original stream */
+    AR_FORMAT_BITWISE = 0,
+    /* 32 bit range moved a byte at a time, with finer probabilities */
+    AR_FORMAT_RANGE = 1,
+    /* range coding with counts of the whole input stored up front, FILE input must seek */
+    AR_FORMAT_STATIC = 2,
+    /* range coding of pixels against their neighbours, with a model per gradient level */
+    AR_FORMAT_IMAGE = 3,
+    /* range coding with adaptive frequencies kept at a power of two total, no division per symbol */
+    AR_FORMAT_SHIFT = 4,
+    /* bits of every byte coded from several context models mixed together, slow but small */
+    AR_FORMAT_MIX = 5,
+    /* every symbol as binary decisions down a tree of probabilities updated with shifts */
+    AR_FORMAT_TREE = 6,
+    AR_NO_FORMAT
+} AR_FORMATS;
+
+typedef struct ar_options_t
+{
+    /* stream the encoder writes, decoding reads the format from the stream */
+    AR_FORMATS format;
+
+    /* raster width for AR_FORMAT_IMAGE and AR_FORMAT_MIX, 0 - read from a PGM header */
+    unsigned int width;
+
+    /* symbols of a block coded from fresh models, 4 KiB to 16 MiB and 1 MiB up for AR_FORMAT_MIX, 0 - one stream */
+    unsigned int blockSize;
+
+    /* threads coding blocks, 0 - one per hardware thread */
+    unsigned int numThreads;
+
+    /* trained prior the models of AR_FORMAT_RANGE, AR_FORMAT_SHIFT and AR_FORMAT_TREE start from, nullptr - none */
+    const dictionary_t* dictionary;
+} ar_options_t;
+
+void ArDefaultOptions(ar_options_t* options);
+
+int ArEncodeFile(FILE* inFile, FILE* outFile, const ar_options_t* options = nullptr);
+int ArDecodeFile(FILE* inFile, FILE* outFile, const ar_options_t* options = nullptr);
+
+/*
+* The same coding between buffers, without stdio, and without allocation
+* but for the row of pixels AR_FORMAT_IMAGE keeps and the model tables of
+* AR_FORMAT_MIX. Blocks are coded one after another on the calling
+* thread, so numThreads is not used. The bytes written go to dstSize, when
+* they do not fit in capacity -1 is returned with errno ENOSPC.
+* ArEncodeBound is enough capacity for any input of size bytes coded with
+* the same options.
+*/
+size_t ArEncodeBound(const size_t size, const ar_options_t* options = nullptr);
+int ArEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ar_options_t* options = nullptr);
+int ArDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const ar_options_t* options = nullptr);
 
 #endif
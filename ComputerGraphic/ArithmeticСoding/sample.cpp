@@ -1,18 +1,60 @@
 #include "pch.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "arcode.h"
 #include <experimental/filesystem>
 
 void main(int argc, const char* argv[])
 {
-    if(argc == 0)
+    if(argc < 2)
         return;
 
-    std::experimental::filesystem::path filePath = argv[1];
+    ar_options_t options;
+    ArDefaultOptions(&options);
+    const char* dictionaryPath = nullptr;
+    for(int i = 1; i < argc - 1; i++)
+    {
+        if(strcmp(argv[i], "-r") == 0)
+            options.format = AR_FORMAT_RANGE;
+        else if(strcmp(argv[i], "-s") == 0)
+            options.format = AR_FORMAT_STATIC;
+        else if(strcmp(argv[i], "-d") == 0)
+            options.format = AR_FORMAT_SHIFT;
+        else if(strcmp(argv[i], "-i") == 0)
+            options.format = AR_FORMAT_IMAGE;
+        else if(strcmp(argv[i], "-m") == 0)
+            options.format = AR_FORMAT_MIX;
+        else if(strcmp(argv[i], "-e") == 0)
+            options.format = AR_FORMAT_TREE;
+        else if((strcmp(argv[i], "-w") == 0) && (i + 1 < argc - 1))
+            options.width = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-b") == 0) && (i + 1 < argc - 1))
+            options.blockSize = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-t") == 0) && (i + 1 < argc - 1))
+            options.numThreads = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-k") == 0) && (i + 1 < argc - 1))
+            dictionaryPath = argv[++i];
+    }
+
+    /* dictionaries are trained by the Huffman sample, they hold the prior too */
+    dictionary_t dictionary;
+    if(dictionaryPath != nullptr)
+    {
+        FILE* dictionaryFile = fopen(dictionaryPath, "rb");
+        if(dictionaryFile == nullptr)
+            return;
+        int status = DictionaryRead(dictionaryFile, &dictionary);
+        fclose(dictionaryFile);
+        if(status != 0)
+            return;
+        options.dictionary = &dictionary;
+    }
+
+    std::experimental::filesystem::path filePath = argv[argc - 1];
     std::string ext = filePath.extension().string();
 
-    if(ext.compare(".Huffman") == 0 || ext.compare(".Rlc") == 0)
+    if(ext.compare(".Huffman") == 0 || ext.compare(".Rlc") == 0 || ext.compare(".Ans") == 0 || ext.compare(".dic") == 0)
         return;
 
     bool encode = ext.compare(".Arc") != 0;
@@ -36,9 +78,9 @@ void main(int argc, const char* argv[])
     }
 
     if(encode)
-        ArEncodeFile(inFile, outFile);
+        ArEncodeFile(inFile, outFile, &options);
     else
-        ArDecodeFile(inFile, outFile);
+        ArDecodeFile(inFile, outFile, &options);
 
     fclose(inFile);
     fclose(outFile);
@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "bitfile.h"
+
+bit_file_t* MakeBitFile(FILE* stream, const BF_MODES mode)
+{
+    if(stream == nullptr)
+    {
+        errno = EBADF;
+        return nullptr;
+    }
+
+    bit_file_t* bf = new bit_file_t();
+    bf->fp = stream;
+    bf->bitBuffer = 0;
+    bf->bitCount = 0;
+    bf->block = new unsigned char[BF_BLOCK_SIZE];
+    bf->blockPos = 0;
+    bf->blockLen = 0;
+    bf->blockSize = BF_BLOCK_SIZE;
+    bf->error = 0;
+    bf->mode = mode;
+    return bf;
+}
+
+void InitBitBuffer(bit_file_t* stream, unsigned char* buffer, const size_t size, const BF_MODES mode)
+{
+    stream->fp = nullptr;
+    stream->bitBuffer = 0;
+    stream->bitCount = 0;
+    stream->block = buffer;
+    stream->blockPos = 0;
+    stream->blockLen = (mode == BF_READ) ? size : 0;
+    stream->blockSize = size;
+    stream->error = 0;
+    stream->mode = mode;
+}
+
+size_t CloseBitBuffer(bit_file_t* stream)
+{
+    if((stream->mode == BF_WRITE) || (stream->mode == BF_APPEND))
+    {
+        stream->bitCount = (stream->bitCount + 7) & ~7u;
+        BitFileDrain(stream);
+        return stream->blockLen;
+    }
+    return stream->blockPos - stream->bitCount / 8;
+}
+
+bit_file_t* MakeBitBuffer(unsigned char* buffer, const size_t size, const BF_MODES mode)
+{
+    if((buffer == nullptr) && (size != 0))
+    {
+        errno = EFAULT;
+        return nullptr;
+    }
+
+    bit_file_t* bf = new bit_file_t();
+    InitBitBuffer(bf, buffer, size, mode);
+    return bf;
+}
+
+size_t BitFileToBuffer(bit_file_t* stream)
+{
+    if(stream == nullptr)
+        return 0;
+
+    size_t used = CloseBitBuffer(stream);
+    delete stream;
+    return used;
+}
+
+FILE* BitFileToFILE(bit_file_t* stream)
+{
+    if((stream == nullptr) || (stream->fp == nullptr))
+        return nullptr;
+
+    if((stream->mode == BF_WRITE) || (stream->mode == BF_APPEND))
+    {
+        /* the last partial byte is padded with zeros */
+        stream->bitCount = (stream->bitCount + 7) & ~7u;
+        BitFileDrain(stream);
+        if(stream->blockLen != 0)
+            fwrite(stream->block, 1, stream->blockLen, stream->fp);
+    }
+    else
+    {
+        /* give back whole bytes that were read ahead but not used */
+        long unread = (long)(stream->blockLen - stream->blockPos) + (long)(stream->bitCount / 8);
+        if(unread != 0)
+            fseek(stream->fp, -unread, SEEK_CUR);
+    }
+
+    FILE* fp = stream->fp;
+    delete[] stream->block;
+    delete stream;
+    return fp;
+}
+
+void BitFileFill(bit_file_t* stream)
+{
+    if(BitFileFillFromBlock(stream))
+        return;
+
+    while(stream->bitCount <= 56)
+    {
+        if(stream->blockPos == stream->blockLen)
+        {
+            if(stream->fp == nullptr)
+                return;
+
+            stream->blockLen = fread(stream->block, 1, BF_BLOCK_SIZE, stream->fp);
+            stream->blockPos = 0;
+            if(stream->blockLen == 0)
+                return;
+        }
+
+        stream->bitBuffer |= (uint64_t)stream->block[stream->blockPos++] << (56 - stream->bitCount);
+        stream->bitCount += 8;
+    }
+}
+
+int BitFileDrain(bit_file_t* stream)
+{
+    while(stream->bitCount >= 8)
+    {
+        if(stream->blockLen == stream->blockSize)
+        {
+            /* a full buffer can not take more, the rest of the bits are dropped */
+            if(stream->fp == nullptr)
+            {
+                stream->error = 1;
+                stream->bitBuffer = 0;
+                stream->bitCount = 0;
+                break;
+            }
+
+            if(fwrite(stream->block, 1, BF_BLOCK_SIZE, stream->fp) != BF_BLOCK_SIZE)
+                stream->error = 1;
+            stream->blockLen = 0;
+        }
+
+        stream->block[stream->blockLen++] = (unsigned char)(stream->bitBuffer >> 56);
+        stream->bitBuffer <<= 8;
+        stream->bitCount -= 8;
+    }
+    return stream->error ? EOF : 0;
+}
+
+int BitFileGetChar(bit_file_t* stream)
+{
+    if(stream == nullptr)
+        return EOF;
+
+    int returnValue = (int)BitFilePeekBits(stream, 8);
+    if(stream->bitCount < 8)
+        return EOF;
+
+    BitFileSkipBits(stream, 8);
+    return returnValue;
+}
+
+int BitFilePutChar(const int c, bit_file_t* stream)
+{
+    if(stream == nullptr)
+        return EOF;
+
+    if(BitFileWriteBits(stream, (unsigned char)c, 8) == EOF)
+        return EOF;
+    return (unsigned char)c;
+}
+
+int BitFileGetBits(bit_file_t* stream, void* bits, const unsigned int count)
+{
+    if((stream == nullptr) || (bits == nullptr))
+        return EOF;
+
+    unsigned char* bytes = (unsigned char*)bits;
+    unsigned int offset = 0;
+    unsigned int remaining = count;
+    while(remaining >= 8)
+    {
+        int returnValue = BitFileGetChar(stream);
+        if(returnValue == EOF)
+            return EOF;
+
+        bytes[offset++] = (unsigned char)returnValue;
+        remaining -= 8;
+    }
+
+    if(remaining != 0)
+    {
+        unsigned char tmp = (unsigned char)BitFilePeekBits(stream, remaining);
+        if(stream->bitCount < remaining)
+            return EOF;
+
+        BitFileSkipBits(stream, remaining);
+        bytes[offset] = tmp << (8 - remaining);
+    }
+    return count;
+}
+
+int BitFilePutBits(bit_file_t* stream, void* bits, const unsigned int count)
+{
+    if((stream == nullptr) || (bits == nullptr))
+        return EOF;
+
+    unsigned char* bytes = (unsigned char*)bits;
+    unsigned int offset = 0;
+    unsigned int remaining = count;
+    while(remaining >= 8)
+    {
+        if(BitFileWriteBits(stream, bytes[offset++], 8) == EOF)
+            return EOF;
+        remaining -= 8;
+    }
+
+    if((remaining != 0) && (BitFileWriteBits(stream, bytes[offset] >> (8 - remaining), remaining) == EOF))
+        return EOF;
+    return count;
+}
+
+static uint64_t LoadNum(const void* bits, const size_t size)
+{
+    switch(size)
+    {
+    case sizeof(uint8_t):
+        return *(const uint8_t*)bits;
+    case sizeof(uint16_t):
+    {
+        uint16_t value;
+        memcpy(&value, bits, sizeof(value));
+        return value;
+    }
+    case sizeof(uint32_t):
+    {
+        uint32_t value;
+        memcpy(&value, bits, sizeof(value));
+        return value;
+    }
+    default:
+    {
+        uint64_t value;
+        memcpy(&value, bits, sizeof(value));
+        return value;
+    }
+    }
+}
+
+static void StoreNum(void* bits, const size_t size, const uint64_t num)
+{
+    switch(size)
+    {
+    case sizeof(uint8_t):
+        *(uint8_t*)bits = (uint8_t)num;
+        break;
+    case sizeof(uint16_t):
+    {
+        uint16_t value = (uint16_t)num;
+        memcpy(bits, &value, sizeof(value));
+        break;
+    }
+    case sizeof(uint32_t):
+    {
+        uint32_t value = (uint32_t)num;
+        memcpy(bits, &value, sizeof(value));
+        break;
+    }
+    default:
+        memcpy(bits, &num, sizeof(num));
+        break;
+    }
+}
+
+/*
+* Numbers go out least significant byte first, then the bits left over from
+* the top byte, whatever the byte order of the host.
+*/
+int BitFilePutBitsNum(bit_file_t* stream, void* bits, const unsigned int count, const size_t size)
+{
+    if((stream == nullptr) || (bits == nullptr))
+        return EOF;
+
+    if((size == 0) || (size > sizeof(uint64_t)) || (count > size * 8))
+        return EOF;
+
+    uint64_t num = LoadNum(bits, size);
+    unsigned int remaining = count;
+    while(remaining >= 8)
+    {
+        if(BitFileWriteBits(stream, (uint32_t)(num & 0xFF), 8) == EOF)
+            return EOF;
+        num >>= 8;
+        remaining -= 8;
+    }
+
+    if((remaining != 0) && (BitFileWriteBits(stream, (uint32_t)num, remaining) == EOF))
+        return EOF;
+    return count;
+}
+
+int BitFileGetBitsNum(bit_file_t* stream, void* bits, const unsigned int count, const size_t size)
+{
+    if((stream == nullptr) || (bits == nullptr))
+        return EOF;
+
+    if((size == 0) || (size > sizeof(uint64_t)) || (count > size * 8))
+        return EOF;
+
+    uint64_t num = 0;
+    unsigned int shift = 0;
+    unsigned int remaining = count;
+    while(remaining >= 8)
+    {
+        int returnValue = BitFileGetChar(stream);
+        if(returnValue == EOF)
+            return EOF;
+
+        num |= (uint64_t)returnValue << shift;
+        shift += 8;
+        remaining -= 8;
+    }
+
+    if(remaining != 0)
+    {
+        uint64_t tmp = BitFilePeekBits(stream, remaining);
+        if(stream->bitCount < remaining)
+            return EOF;
+
+        BitFileSkipBits(stream, remaining);
+        num |= tmp << shift;
+    }
+
+    StoreNum(bits, size, num);
+    return count;
+}
+
+size_t BitFileGetBytes(bit_file_t* stream, void* bytes, const size_t count)
+{
+    if((stream == nullptr) || (bytes == nullptr))
+        return 0;
+
+    /* bytes already in the accumulator go first */
+    unsigned char* out = (unsigned char*)bytes;
+    size_t done = 0;
+    while((done < count) && (stream->bitCount >= 8))
+    {
+        out[done++] = (unsigned char)(stream->bitBuffer >> 56);
+        BitFileSkipBits(stream, 8);
+    }
+
+    size_t fromBlock = stream->blockLen - stream->blockPos;
+    if(fromBlock > count - done)
+        fromBlock = count - done;
+    memcpy(out + done, stream->block + stream->blockPos, fromBlock);
+    stream->blockPos += fromBlock;
+    done += fromBlock;
+
+    if((done < count) && (stream->fp != nullptr))
+        done += fread(out + done, 1, count - done, stream->fp);
+    return done;
+}
+
+size_t BitFilePutBytes(bit_file_t* stream, const void* bytes, const size_t count)
+{
+    if((stream == nullptr) || (bytes == nullptr))
+        return 0;
+
+    const unsigned char* in = (const unsigned char*)bytes;
+    if((stream->bitCount % 8) != 0)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            if(BitFileWriteBits(stream, in[i], 8) == EOF)
+                return i;
+        }
+        return count;
+    }
+
+    if(BitFileDrain(stream) == EOF)
+        return 0;
+
+    if(stream->fp == nullptr)
+    {
+        size_t room = stream->blockSize - stream->blockLen;
+        size_t done = (count < room) ? count : room;
+        memcpy(stream->block + stream->blockLen, in, done);
+        stream->blockLen += done;
+        if(done < count)
+            stream->error = 1;
+        return done;
+    }
+
+    if(stream->blockLen != 0)
+    {
+        if(fwrite(stream->block, 1, stream->blockLen, stream->fp) != stream->blockLen)
+            stream->error = 1;
+        stream->blockLen = 0;
+    }
+
+    size_t done = fwrite(in, 1, count, stream->fp);
+    if(done != count)
+        stream->error = 1;
+    return done;
+}
+
+unsigned char* BitFileBufferBytes(bit_file_t* stream, const size_t count)
+{
+    if((stream == nullptr) || (stream->fp != nullptr) || ((stream->bitCount % 8) != 0))
+        return nullptr;
+
+    if(stream->mode == BF_READ)
+    {
+        /* whole bytes read ahead into the accumulator go back to the buffer */
+        stream->blockPos -= stream->bitCount / 8;
+        stream->bitBuffer = 0;
+        stream->bitCount = 0;
+        if(count > stream->blockLen - stream->blockPos)
+            return nullptr;
+
+        unsigned char* bytes = stream->block + stream->blockPos;
+        stream->blockPos += count;
+        return bytes;
+    }
+
+    if(BitFileDrain(stream) == EOF)
+        return nullptr;
+
+    if(count > stream->blockSize - stream->blockLen)
+    {
+        stream->error = 1;
+        return nullptr;
+    }
+
+    unsigned char* bytes = stream->block + stream->blockLen;
+    stream->blockLen += count;
+    return bytes;
+}
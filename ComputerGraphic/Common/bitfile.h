@@ -0,0 +1,162 @@
+#ifndef _BITFILE_H_
+#define _BITFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum
+{
+    BF_READ = 0,
+    BF_WRITE = 1,
+    BF_APPEND = 2,
+    BF_NO_MODE
+} BF_MODES;
+
+/* bytes moved between a bit file and its FILE at a time */
+#define BF_BLOCK_SIZE   (1 << 16)
+
+/*
+* Bits are kept MSB first in a 64 bit accumulator in front of a block of
+* BF_BLOCK_SIZE bytes, so the inline calls below only reach the FILE once
+* per block. A bit file made over a buffer has no FILE and uses the buffer
+* as its only block. The layout is public only to let those calls be inlined.
+*/
+typedef struct bit_file_t
+{
+    FILE* fp;
+    uint64_t bitBuffer;
+    unsigned int bitCount;
+    unsigned char* block;
+    size_t blockPos;
+    size_t blockLen;
+    size_t blockSize;
+    int error;
+    BF_MODES mode;
+} bit_file_t;
+
+bit_file_t* MakeBitFile(FILE* stream, const BF_MODES mode);
+FILE* BitFileToFILE(bit_file_t* stream);
+
+/* bit file over size bytes of memory, BitFileToBuffer returns the bytes used */
+bit_file_t* MakeBitBuffer(unsigned char* buffer, const size_t size, const BF_MODES mode);
+size_t BitFileToBuffer(bit_file_t* stream);
+
+/* the same over a caller's bit_file_t, nothing is allocated or freed */
+void InitBitBuffer(bit_file_t* stream, unsigned char* buffer, const size_t size, const BF_MODES mode);
+size_t CloseBitBuffer(bit_file_t* stream);
+
+int BitFileGetChar(bit_file_t* stream);
+int BitFilePutChar(const int c, bit_file_t* stream);
+
+int BitFileGetBits(bit_file_t* stream, void* bits, const unsigned int count);
+int BitFilePutBits(bit_file_t* stream, void* bits, const unsigned int count);
+
+int BitFileGetBitsNum(bit_file_t* stream, void* bits, const unsigned int count, const size_t size);
+int BitFilePutBitsNum(bit_file_t* stream, void* bits, const unsigned int count, const size_t size);
+
+/* whole bytes moved past the accumulator in bulk, reads must start at a byte boundary */
+size_t BitFileGetBytes(bit_file_t* stream, void* bytes, const size_t count);
+size_t BitFilePutBytes(bit_file_t* stream, const void* bytes, const size_t count);
+
+/*
+* The next count bytes of a bit file over memory at a byte boundary, handed
+* out in place and stepped over: read by the caller in read mode, filled in
+* by it otherwise. nullptr for a FILE or when fewer bytes are left.
+*/
+unsigned char* BitFileBufferBytes(bit_file_t* stream, const size_t count);
+
+/* slow paths of the inline calls: refill the accumulator, move whole bytes out of it */
+void BitFileFill(bit_file_t* stream);
+int BitFileDrain(bit_file_t* stream);
+
+/*
+* Tops the accumulator up to more than 56 bits with one 8 byte load from the
+* block. Returns 0 and leaves the stream as it was when fewer than 8 bytes
+* are left in the block, BitFileFill then does the rest.
+*/
+inline int BitFileFillFromBlock(bit_file_t* stream)
+{
+    if(stream->blockLen - stream->blockPos < 8)
+        return 0;
+
+    const unsigned char* p = stream->block + stream->blockPos;
+    uint64_t word = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+        | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+    unsigned int bytes = (63 - stream->bitCount) / 8;
+    unsigned int bitCount = stream->bitCount + 8 * bytes;
+    stream->bitBuffer |= (word >> stream->bitCount) & ~(~(uint64_t)0 >> bitCount);
+    stream->bitCount = bitCount;
+    stream->blockPos += bytes;
+    return 1;
+}
+
+/* the next count (at most 32) bits, for callers that know they are in the accumulator */
+inline uint32_t BitFileShowBits(const bit_file_t* stream, const unsigned int count)
+{
+    return (uint32_t)(stream->bitBuffer >> (64 - count));
+}
+
+/* the next count (at most 32) bits without consuming them, zero padded past the end */
+inline uint32_t BitFilePeekBits(bit_file_t* stream, const unsigned int count)
+{
+    if(stream->bitCount < count)
+        BitFileFill(stream);
+    return (uint32_t)(stream->bitBuffer >> (64 - count));
+}
+
+/* bits left in the accumulator, after a peek at least the peeked count unless the file ended */
+inline unsigned int BitFileBitsAvailable(const bit_file_t* stream)
+{
+    return stream->bitCount;
+}
+
+inline void BitFileSkipBits(bit_file_t* stream, const unsigned int count)
+{
+    if(count >= stream->bitCount)
+    {
+        stream->bitBuffer = 0;
+        stream->bitCount = 0;
+        return;
+    }
+    stream->bitBuffer <<= count;
+    stream->bitCount -= count;
+}
+
+/* writes the count (at most 32) low bits of value, MSB first */
+inline int BitFileWriteBits(bit_file_t* stream, const uint32_t value, const unsigned int count)
+{
+    if(count == 0)
+        return 0;
+
+    if((stream->bitCount + count > 64) && (BitFileDrain(stream) == EOF))
+        return EOF;
+
+    uint64_t bits = value & ((~(uint64_t)0) >> (64 - count));
+    stream->bitBuffer |= bits << (64 - stream->bitCount - count);
+    stream->bitCount += count;
+    return count;
+}
+
+inline int BitFileGetBit(bit_file_t* stream)
+{
+    if(stream->bitCount == 0)
+    {
+        BitFileFill(stream);
+        if(stream->bitCount == 0)
+            return EOF;
+    }
+
+    int returnValue = (int)(stream->bitBuffer >> 63);
+    stream->bitBuffer <<= 1;
+    stream->bitCount--;
+    return returnValue;
+}
+
+inline int BitFilePutBit(const int c, bit_file_t* stream)
+{
+    if(BitFileWriteBits(stream, (c != 0), 1) == EOF)
+        return EOF;
+    return c;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "bitfile.h"
+#include "dictionary.h"
+
+/* "DIC", the version, the id, the code lengths a byte each and the prior 16 bits each */
+#define DICTIONARY_MAGIC    0x444943
+#define DICTIONARY_VERSION  1
+
+static uint32_t DictionaryHash(const dictionary_t* dictionary);
+
+int DictionaryCount(FILE* inFile, uint64_t* counts)
+{
+    unsigned char block[BF_BLOCK_SIZE];
+    size_t len;
+    while((len = fread(block, 1, sizeof(block), inFile)) != 0)
+    {
+        for(size_t i = 0; i < len; i++)
+            counts[block[i]]++;
+    }
+    return ferror(inFile) ? -1 : 0;
+}
+
+/*
+* Every symbol keeps a count of at least 1 so a model never rules it out,
+* the rest of DICTIONARY_PRIOR_TOTAL is shared out by the counts and what
+* rounding leaves goes a count each to the symbols it cut the most from.
+* The end of stream comes once per stream, so it gets the least. Without
+* counts every byte gets the same share.
+*/
+void DictionaryFinish(dictionary_t* dictionary, const uint64_t* counts)
+{
+    const uint64_t shared = DICTIONARY_PRIOR_TOTAL - DICTIONARY_SYMBOLS;
+    uint64_t total = 0;
+    for(int c = 0; c < DICTIONARY_SYMBOLS - 1; c++)
+        total += counts[c];
+
+    /* count * shared fits 64 bits while total is under 2^40, past that both lose the same low bits */
+    int shift = 0;
+    while((total >> shift) >= ((uint64_t)1 << 40))
+        shift++;
+    total >>= shift;
+
+    const bool uniform = (total == 0);
+    if(uniform)
+        total = DICTIONARY_SYMBOLS - 1;
+
+    uint64_t remainder[DICTIONARY_SYMBOLS];
+    unsigned int sum = 0;
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+    {
+        uint64_t count = 0;
+        if(c < DICTIONARY_SYMBOLS - 1)
+            count = uniform ? 1 : (counts[c] >> shift);
+
+        dictionary->prior[c] = (unsigned short)(1 + count * shared / total);
+        remainder[c] = count * shared % total;
+        sum += dictionary->prior[c];
+    }
+
+    while(sum < DICTIONARY_PRIOR_TOTAL)
+    {
+        int most = 0;
+        for(int c = 1; c < DICTIONARY_SYMBOLS; c++)
+        {
+            if(remainder[c] > remainder[most])
+                most = c;
+        }
+        dictionary->prior[most]++;
+        remainder[most] = 0;
+        sum++;
+    }
+    dictionary->id = DictionaryHash(dictionary);
+}
+
+int DictionaryRead(FILE* inFile, dictionary_t* dictionary)
+{
+    bit_file_t* bfp = MakeBitFile(inFile, BF_READ);
+    if(bfp == nullptr)
+        return -1;
+
+    bool valid = (BitFilePeekBits(bfp, 24) == DICTIONARY_MAGIC);
+    BitFileSkipBits(bfp, 24);
+    valid = valid && (BitFilePeekBits(bfp, 8) == DICTIONARY_VERSION);
+    BitFileSkipBits(bfp, 8);
+    dictionary->id = BitFilePeekBits(bfp, 32);
+    BitFileSkipBits(bfp, 32);
+
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+    {
+        dictionary->codeLengths[c] = (unsigned char)BitFilePeekBits(bfp, 8);
+        BitFileSkipBits(bfp, 8);
+    }
+
+    unsigned int sum = 0;
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+    {
+        dictionary->prior[c] = (unsigned short)BitFilePeekBits(bfp, 16);
+        valid = valid && (BitFileBitsAvailable(bfp) >= 16) && (dictionary->prior[c] != 0);
+        BitFileSkipBits(bfp, 16);
+        sum += dictionary->prior[c];
+    }
+
+    inFile = BitFileToFILE(bfp);
+    if(!valid || (sum != DICTIONARY_PRIOR_TOTAL) || (dictionary->id != DictionaryHash(dictionary)))
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+    return 0;
+}
+
+int DictionaryWrite(FILE* outFile, const dictionary_t* dictionary)
+{
+    bit_file_t* bfp = MakeBitFile(outFile, BF_WRITE);
+    if(bfp == nullptr)
+        return -1;
+
+    BitFileWriteBits(bfp, DICTIONARY_MAGIC, 24);
+    BitFileWriteBits(bfp, DICTIONARY_VERSION, 8);
+    BitFileWriteBits(bfp, dictionary->id, 32);
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+        BitFileWriteBits(bfp, dictionary->codeLengths[c], 8);
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+        BitFileWriteBits(bfp, dictionary->prior[c], 16);
+
+    int error = bfp->error;
+    outFile = BitFileToFILE(bfp);
+    if((error != 0) || ferror(outFile))
+        return -1;
+    return 0;
+}
+
+/* FNV-1a over both tables */
+static uint32_t DictionaryHash(const dictionary_t* dictionary)
+{
+    uint32_t hash = 2166136261u;
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+        hash = (hash ^ dictionary->codeLengths[c]) * 16777619u;
+    for(int c = 0; c < DICTIONARY_SYMBOLS; c++)
+    {
+        hash = (hash ^ (dictionary->prior[c] >> 8)) * 16777619u;
+        hash = (hash ^ (dictionary->prior[c] & 0xFF)) * 16777619u;
+    }
+    return hash;
+}
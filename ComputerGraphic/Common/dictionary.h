@@ -0,0 +1,36 @@
+#ifndef _DICTIONARY_H_
+#define _DICTIONARY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* every byte and the end of stream symbol */
+#define DICTIONARY_SYMBOLS      257
+
+/* what the prior counts add up to */
+#define DICTIONARY_PRIOR_TOTAL  (1u << 16)
+
+/*
+* Symbol statistics trained on a corpus ahead of time: canonical Huffman
+* code lengths and the counts adaptive arithmetic models start from. A
+* stream coded with a dictionary carries only its id, so the decoder needs
+* the same dictionary. The id is a hash of the tables.
+*/
+typedef struct dictionary_t
+{
+    uint32_t id;
+    unsigned char codeLengths[DICTIONARY_SYMBOLS];
+    unsigned short prior[DICTIONARY_SYMBOLS];
+} dictionary_t;
+
+/* adds the bytes of inFile to counts, DICTIONARY_SYMBOLS of them */
+int DictionaryCount(FILE* inFile, uint64_t* counts);
+
+/* the prior from counts and the id, once codeLengths are filled in */
+void DictionaryFinish(dictionary_t* dictionary, const uint64_t* counts);
+
+/* -1 with errno EILSEQ for a file that is not a dictionary or was damaged */
+int DictionaryRead(FILE* inFile, dictionary_t* dictionary);
+int DictionaryWrite(FILE* outFile, const dictionary_t* dictionary);
+
+#endif
@@ -0,0 +1,46 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+
+unsigned int ParallelThreads(unsigned int numThreads)
+{
+    if(numThreads != 0)
+        return numThreads;
+
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return (hardwareThreads != 0) ? hardwareThreads : 1;
+}
+
+static void ParallelWorker(std::atomic<int>* next, int count, void (*work)(void* context, int index), void* context)
+{
+    int index;
+    while((index = next->fetch_add(1)) < count)
+        work(context, index);
+}
+
+void ParallelFor(int count, unsigned int numThreads, void (*work)(void* context, int index), void* context)
+{
+    numThreads = ParallelThreads(numThreads);
+    if((unsigned int)count < numThreads)
+        numThreads = (count > 0) ? count : 1;
+
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for(unsigned int i = 1; i < numThreads; i++)
+    {
+        /* threads that can not be started leave their share to the others */
+        try
+        {
+            threads.push_back(std::thread(ParallelWorker, &next, count, work, context));
+        }
+        catch(...)
+        {
+            break;
+        }
+    }
+
+    ParallelWorker(&next, count, work, context);
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
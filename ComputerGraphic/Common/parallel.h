@@ -0,0 +1,15 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/* threads used for a request of numThreads, 0 - one per hardware thread */
+unsigned int ParallelThreads(unsigned int numThreads);
+
+/*
+* Calls work(context, i) once for every i below count, on up to numThreads
+* threads counting the calling one, and returns when all calls are done.
+* Indices are handed out in order, but calls may finish in any order, so
+* work must only touch what belongs to its index.
+*/
+void ParallelFor(int count, unsigned int numThreads, void (*work)(void* context, int index), void* context);
+
+#endif
@@ -0,0 +1,36 @@
+#include <string.h>
+#include "sink.h"
+
+void InitSink(symbol_sink_t* sink, FILE* fp, unsigned char* buffer, const size_t size)
+{
+    sink->fp = fp;
+    sink->buffer = buffer;
+    sink->size = size;
+    sink->len = 0;
+}
+
+int SinkWrite(symbol_sink_t* sink, const unsigned char* symbols, const size_t len)
+{
+    if(sink->fp != nullptr)
+    {
+        fwrite(symbols, 1, len, sink->fp);
+        return 0;
+    }
+
+    if(len > sink->size - sink->len)
+        return EOF;
+
+    memcpy(sink->buffer + sink->len, symbols, len);
+    sink->len += len;
+    return 0;
+}
+
+unsigned char* SinkReserve(symbol_sink_t* sink, const size_t len)
+{
+    if(len > sink->size - sink->len)
+        return nullptr;
+
+    unsigned char* symbols = sink->buffer + sink->len;
+    sink->len += len;
+    return symbols;
+}
@@ -0,0 +1,23 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <stdio.h>
+
+/* where decoded symbols go: a FILE, or when fp is nullptr size bytes of a caller's buffer */
+typedef struct symbol_sink_t
+{
+    FILE* fp;
+    unsigned char* buffer;
+    size_t size;
+    size_t len;
+} symbol_sink_t;
+
+void InitSink(symbol_sink_t* sink, FILE* fp, unsigned char* buffer, const size_t size);
+
+/* 0, or EOF when a buffer sink has no room for len more symbols */
+int SinkWrite(symbol_sink_t* sink, const unsigned char* symbols, const size_t len);
+
+/* room for len symbols decoded in place into a buffer sink, nullptr when they do not fit */
+unsigned char* SinkReserve(symbol_sink_t* sink, const size_t len);
+
+#endif
@@ -3,260 +3,1840 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <new>
 #include "huflocal.h"
 #include "huffman.h"
-#include "bitarray.h"
 #include "bitfile.h"
+#include "parallel.h"
+#include "sink.h"
 
-typedef struct code_list_t
+/*
+* A stream starts either with the version 1 header (symbol/count pairs
+* closed by a zero pair) or with HUFFMAN_MAGIC followed by a zero count and
+* a version byte. Version 1 never writes a zero count for a non-zero symbol,
+* so the two can not be confused.
+*/
+#define HUFFMAN_MAGIC               'H'
+#define HUFFMAN_VERSION_TREE        1   /* symbol counts, codes from the rebuilt tree */
+#define HUFFMAN_VERSION_CANONICAL   2   /* nibble packed canonical code lengths */
+#define HUFFMAN_VERSION_INTERLEAVED 3   /* canonical codes dealt to sub-streams behind a jump table */
+#define HUFFMAN_VERSION_BLOCKS      4   /* independently coded blocks behind a block index */
+#define HUFFMAN_VERSION_ADAPTIVE    5   /* one pass FGK codes, nothing but the signature up front */
+#define HUFFMAN_VERSION_DICTIONARY  6   /* canonical codes of a trained dictionary, named by its id */
+
+/* bits of a symbol sent after the NYT code, enough for EOF_CHAR */
+#define ADAPTIVE_SYMBOL_BITS        9
+
+/* longest adaptive code, weights grow at least as Fibonacci numbers with depth up to ADAPTIVE_MAX_WEIGHT */
+#define ADAPTIVE_CODE_BOUND         48
+
+/* bytes of the magic, zero count and version in front of a stream */
+#define SIGNATURE_SIZE              (2 + sizeof(count_t))
+
+/* most sub-streams an interleaved stream may have */
+#define MAX_STREAMS                 16
+
+/* symbols of one interleaved block, and a bound on the bytes they are coded in */
+#define INTERLEAVED_BLOCK_SIZE      (1 << 17)
+#define INTERLEAVED_BUFFER_SIZE     INTERLEAVED_BOUND(INTERLEAVED_BLOCK_SIZE)
+#define INTERLEAVED_BOUND(n)        (((size_t)(n) * MAX_CODE_LEN) / 8 + MAX_STREAMS)
+
+/* block sizes of a block stream, and the bytes a block's code lengths and jump table take at most */
+#define MIN_BLOCK_SIZE              (1 << 12)
+#define MAX_BLOCK_SIZE              (1 << 24)
+#define BLOCK_HEADER_BOUND          (NUM_CHARS + 1 + MAX_STREAMS * sizeof(count_t))
+
+/* blocks a block stream decoder holds in memory at once */
+#define BLOCK_BATCH                 64
+
+/* header nibble announcing a code length of 15 plus the next nibble */
+#define LONG_LEN_NIBBLE             15
+
+/* number of bits resolved by one decode table lookup */
+#define DECODE_LOOKUP_BITS  11
+#define DECODE_TABLE_SIZE   (1 << DECODE_LOOKUP_BITS)
+
+/* size of the blocks a FILE is read and decoded symbols are written in */
+#define IO_BLOCK_SIZE     (1 << 16)
+
+/* decoded symbols gathered on the stack before they go to the sink */
+#define OUT_BLOCK_SIZE    (1 << 12)
+
+typedef struct decode_entry_t
+{
+    unsigned short symbols[2];
+    unsigned char numSymbols;   /* 0 - code is longer than DECODE_LOOKUP_BITS */
+    unsigned char bits;         /* bits consumed by all symbols of the entry */
+    unsigned char firstBits;    /* bits consumed by the first symbol alone */
+} decode_entry_t;
+
+typedef struct decode_table_t
+{
+    decode_entry_t entries[DECODE_TABLE_SIZE];
+
+    /* node reached after DECODE_LOOKUP_BITS bits of a long code */
+    short subtrees[DECODE_TABLE_SIZE];
+
+    /* canonical codes longer than DECODE_LOOKUP_BITS */
+    int maxCodeLen;
+    uint32_t firstCode[MAX_CODE_LEN + 1];
+    unsigned short lengthCount[MAX_CODE_LEN + 1];
+    unsigned short firstIndex[MAX_CODE_LEN + 1];
+    unsigned short sortedSymbols[NUM_CHARS];
+} decode_table_t;
+
+/* why decoding stopped, HuffmanDecodeFile reports it on stderr */
+typedef enum
+{
+    DECODE_OK = 0,
+    DECODE_BAD_HEADER,
+    DECODE_BAD_STREAM,
+    DECODE_BAD_VERSION,
+    DECODE_NO_ROOM,
+    DECODE_NO_DICTIONARY,
+    DECODE_NO_MEMORY
+} DECODE_STATUS;
+
+static int OptionsCodeLen(const huffman_options_t* options);
+static int ValidDictionaryCodes(const byte_t* codeLengths);
+static int ReadInputFile(FILE* inFile, byte_t** data, size_t* size);
+static int EncodeInput(FILE* inFile, const byte_t* data, size_t size, const count_t* counts, bit_file_t* bOutFile,
+    const huffman_options_t* options, int maxCodeLen);
+static int EncodeCanonicalFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const byte_t* codeLengths);
+static void MakeFileCodeLengths(const count_t* counts, int maxCodeLen, byte_t* codeLengths);
+static int EncodeInterleavedFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const byte_t* codeLengths,
+    int numStreams);
+static void EncodeInterleavedBlock(const byte_t* block, size_t blockLen, const byte_t* codeLengths, const uint32_t* codes,
+    int numStreams, unsigned char* buffer, bit_file_t* bOutFile);
+static int EncodeBlockFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const huffman_options_t* options,
+    int maxCodeLen);
+static int EncodeBlockBuffer(const byte_t* data, size_t size, bit_file_t* bOutFile, int numStreams, size_t blockSize,
+    int maxCodeLen, int numBlocks);
+static void EncodeCodedBlock(const byte_t* block, size_t blockLen, int numStreams, int maxCodeLen, bit_file_t* bfp);
+static void SplitBlock(const byte_t* block, size_t blockLen, int numStreams, const byte_t** segments);
+static int EncodeAdaptiveFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile);
+static int EncodeDictionaryFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile,
+    const dictionary_t* dictionary);
+static void EncodeAdaptiveSymbols(adaptive_tree_t* tree, const byte_t* symbols, size_t len, bit_file_t* bOutFile);
+
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options);
+static DECODE_STATUS DecodeTreeFile(bit_file_t* bInFile, int c, count_t count, symbol_sink_t* sink);
+static DECODE_STATUS DecodeCanonicalFile(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeInterleavedFile(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeBlockFile(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options);
+static DECODE_STATUS DecodeBlockBuffer(bit_file_t* bInFile, symbol_sink_t* sink, int numStreams, size_t blockSize,
+    count_t numSymbols, int numBlocks);
+static DECODE_STATUS DecodeCodedBlock(bit_file_t* bfp, int numStreams, byte_t* block, size_t blockLen);
+static DECODE_STATUS DecodeAdaptiveFile(bit_file_t* bInFile, symbol_sink_t* sink);
+static DECODE_STATUS DecodeDictionaryFile(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options);
+static DECODE_STATUS DecodeInterleavedData(const decode_table_t* table, int numStreams, bit_file_t* bInFile,
+    unsigned char* buffer, size_t bufferSize, byte_t* block, size_t blockLen);
+
+static void BuildDecodeTable(decode_table_t* table, const huffman_tree_t* tree);
+static int BuildCanonicalDecodeTable(decode_table_t* table, const byte_t* codeLengths);
+static DECODE_STATUS DecodeStream(const huffman_tree_t* tree, const decode_table_t* table, bit_file_t* bInFile, symbol_sink_t* sink);
+static int DecodeInterleavedBlock(const decode_table_t* table, bit_file_t** streams, int numStreams, byte_t* block, size_t blockLen);
+
+static int ReadHeader(count_t* counts, bit_file_t* bfp, int c, count_t count);
+
+static void WriteSignature(bit_file_t* bfp, int version);
+static void WriteCanonicalHeader(const byte_t* codeLengths, bit_file_t* bfp);
+static int ReadCanonicalHeader(byte_t* codeLengths, bit_file_t* bfp);
+
+void HuffmanDefaultOptions(huffman_options_t* options)
+{
+    options->maxCodeLen = 0;
+    options->numStreams = 0;
+    options->blockSize = 0;
+    options->numThreads = 0;
+    options->adaptive = 0;
+    options->dictionary = nullptr;
+}
+
+int HuffmanEncodeFile(FILE* inFile, FILE* outFile, const huffman_options_t* options)
 {
-    byte_t codeLen;
-    bit_array_t* code;
-} code_list_t;
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    huffman_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        HuffmanDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    int maxCodeLen = OptionsCodeLen(options);
+    if(maxCodeLen < 0)
+        return -1;
+
+    bit_file_t* bOutFile = MakeBitFile(outFile, BF_WRITE);
+
+    if(nullptr == bOutFile)
+    {
+        perror("Making Output File a BitFile");
+        return -1;
+    }
+
+    int status;
+    if(options->dictionary != nullptr)
+    {
+        status = EncodeDictionaryFile(inFile, nullptr, 0, bOutFile, options->dictionary);
+    }
+    else if(options->adaptive != 0)
+    {
+        status = EncodeAdaptiveFile(inFile, nullptr, 0, bOutFile);
+    }
+    else
+    {
+        /* counting and coding run over one copy of the input, the FILE is read twice only if it can not be held */
+        byte_t* data;
+        size_t size;
+        count_t counts[NUM_CHARS];
+        status = ReadInputFile(inFile, &data, &size);
+        if(0 == status)
+            status = (data != nullptr) ? CountBufferSymbols(data, size, counts) : CountSymbols(inFile, counts);
+        if(0 == status)
+            status = EncodeInput(inFile, data, size, counts, bOutFile, options, maxCodeLen);
+        delete[] data;
+    }
+
+    outFile = BitFileToFILE(bOutFile);
+    return status;
+}
+
+int HuffmanEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const huffman_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    huffman_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        HuffmanDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    int maxCodeLen = OptionsCodeLen(options);
+    if(maxCodeLen < 0)
+        return -1;
+
+    /* data is nullptr only for a FILE that could not be held, an empty buffer may come without one */
+    static const byte_t noData[1] = { 0 };
+    const byte_t* data = (src != nullptr) ? src : noData;
+
+    bit_file_t bOutFile;
+    InitBitBuffer(&bOutFile, dst, capacity, BF_WRITE);
+
+    int status;
+    if(options->dictionary != nullptr)
+    {
+        status = EncodeDictionaryFile(nullptr, data, size, &bOutFile, options->dictionary);
+    }
+    else if(options->adaptive != 0)
+    {
+        status = EncodeAdaptiveFile(nullptr, data, size, &bOutFile);
+    }
+    else
+    {
+        count_t counts[NUM_CHARS];
+        status = CountBufferSymbols(data, size, counts);
+        if(0 == status)
+            status = EncodeInput(nullptr, data, size, counts, &bOutFile, options, maxCodeLen);
+    }
+
+    /* whatever did not fit was dropped by the bit file */
+    size_t used = CloseBitBuffer(&bOutFile);
+    if((0 == status) && (0 != bOutFile.error))
+    {
+        errno = ENOSPC;
+        status = -1;
+    }
+
+    if(0 == status)
+        *dstSize = used;
+    return status;
+}
+
+/*
+* Every stream is bounded through the cost of its codes: an optimal code for
+* counts that include EOF_CHAR never does worse than a flat 9 bit code, and
+* a code length limit is never below 9. The adaptive tree is rebuilt before
+* its root weight reaches ADAPTIVE_MAX_WEIGHT, which keeps its codes under
+* ADAPTIVE_CODE_BOUND bits.
+*/
+size_t HuffmanEncodeBound(const size_t size, const huffman_options_t* options)
+{
+    huffman_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        HuffmanDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    size_t numStreams = (options->numStreams != 0) ? options->numStreams : 1;
+    size_t bound = SIGNATURE_SIZE;
+    if(options->dictionary != nullptr)
+    {
+        /* the dictionary codes are no longer than MAX_CODE_LEN, but need not suit the input */
+        return bound + sizeof(uint32_t) + ((size + 1) * MAX_CODE_LEN + 7) / 8;
+    }
+
+    if(options->adaptive != 0)
+        return bound + ((size + 1) * (ADAPTIVE_CODE_BOUND + ADAPTIVE_SYMBOL_BITS) + 7) / 8;
+
+    if(options->blockSize != 0)
+    {
+        size_t numBlocks = (size + options->blockSize - 1) / options->blockSize;
+        bound += 1 + 2 * sizeof(count_t) + numBlocks * sizeof(count_t);
+        return bound + numBlocks * (BLOCK_HEADER_BOUND + numStreams) + ((size + numBlocks) * 9 + 7) / 8;
+    }
+
+    bound += NUM_CHARS;
+    if(numStreams > 1)
+    {
+        size_t numBlocks = (size + INTERLEAVED_BLOCK_SIZE - 1) / INTERLEAVED_BLOCK_SIZE;
+        bound += 1 + sizeof(count_t) + numBlocks * numStreams * (sizeof(count_t) + 1);
+    }
+    return bound + ((size + 1) * 9 + 7) / 8;
+}
+
+/*
+* maxCodeLen of the options, -1 with errno EINVAL for options out of range.
+* A dictionary brings its own single stream of codes, so it goes with
+* neither blocks, sub-streams nor adaptive codes.
+*/
+static int OptionsCodeLen(const huffman_options_t* options)
+{
+    int maxCodeLen = (options->maxCodeLen != 0) ? options->maxCodeLen : MAX_CODE_LEN;
+    if((maxCodeLen < MIN_CODE_LEN_LIMIT) || (maxCodeLen > MAX_CODE_LEN) || (options->numStreams > MAX_STREAMS)
+        || ((options->blockSize != 0) && ((options->blockSize < MIN_BLOCK_SIZE) || (options->blockSize > MAX_BLOCK_SIZE))))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if((options->dictionary != nullptr) && ((options->blockSize != 0) || (options->numStreams > 1) || (options->adaptive != 0)
+        || (ValidDictionaryCodes(options->dictionary->codeLengths) != 0)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return maxCodeLen;
+}
+
+/* a dictionary has to give every symbol a code, or its inputs could not all be coded */
+static int ValidDictionaryCodes(const byte_t* codeLengths)
+{
+    for(int c = 0; c < NUM_CHARS; c++)
+    {
+        if((codeLengths[c] == 0) || (codeLengths[c] > MAX_CODE_LEN))
+            return -1;
+    }
+
+    decode_table_t decodeTable;
+    return BuildCanonicalDecodeTable(&decodeTable, codeLengths);
+}
+
+/*
+* Counts are scaled to fit count_t and every symbol gets at least 1, so
+* whatever an input brings it can be coded. The code lengths follow the
+* length limit of the options like those of a stream.
+*/
+int HuffmanTrainDictionary(const uint64_t* counts, dictionary_t* dictionary, const huffman_options_t* options)
+{
+    if((nullptr == counts) || (nullptr == dictionary))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    huffman_options_t defaultOptions;
+    if(options == nullptr)
+    {
+        HuffmanDefaultOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    int maxCodeLen = (options->maxCodeLen != 0) ? options->maxCodeLen : MAX_CODE_LEN;
+    if((maxCodeLen < MIN_CODE_LEN_LIMIT) || (maxCodeLen > MAX_CODE_LEN))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t largest = 0;
+    for(int c = 0; c < NUM_CHARS; c++)
+        largest = max(largest, counts[c]);
+
+    int shift = 0;
+    while((largest >> shift) >= COUNT_T_MAX / (2 * NUM_CHARS))
+        shift++;
+
+    count_t scaled[NUM_CHARS];
+    for(int c = 0; c < NUM_CHARS; c++)
+        scaled[c] = (count_t)(counts[c] >> shift) + 1;
+
+    MakeFileCodeLengths(scaled, maxCodeLen, dictionary->codeLengths);
+    DictionaryFinish(dictionary, counts);
+    return 0;
+}
+
+/*
+* Codes the size symbols of data, or when data is nullptr those of inFile
+* read a second time. inFile is nullptr when a buffer is coded into memory,
+* the bit file then takes sub-streams and blocks in place.
+*/
+static int EncodeInput(FILE* inFile, const byte_t* data, size_t size, const count_t* counts, bit_file_t* bOutFile,
+    const huffman_options_t* options, int maxCodeLen)
+{
+    /* blocks and sub-streams are sized up front, so an input that could not be held gets a single stream */
+    if((data != nullptr) && (options->blockSize != 0))
+        return EncodeBlockFile(inFile, data, size, bOutFile, options, maxCodeLen);
+
+    byte_t codeLengths[NUM_CHARS];
+    MakeFileCodeLengths(counts, maxCodeLen, codeLengths);
+
+    if((data != nullptr) && (options->numStreams > 1))
+        return EncodeInterleavedFile(inFile, data, size, bOutFile, codeLengths, options->numStreams);
+    return EncodeCanonicalFile(inFile, data, size, bOutFile, codeLengths);
+}
+
+/* the plain tree is kept whenever it fits, package-merge only reshapes deeper ones */
+static void MakeFileCodeLengths(const count_t* counts, int maxCodeLen, byte_t* codeLengths)
+{
+    huffman_tree_t huffmanTree;
+    BuildHuffmanTree(&huffmanTree, counts);
+    int treeDepth = MakeCodeLengths(&huffmanTree, codeLengths);
+    if(treeDepth > maxCodeLen)
+        MakeLimitedCodeLengths(counts, maxCodeLen, codeLengths);
+}
+
+/*
+* Reads the rest of the input into memory, a seekable input with one fread
+* of its known size. Leaves *data nullptr if the first buffer can not be
+* allocated, the FILE is then still untouched.
+*/
+static int ReadInputFile(FILE* inFile, byte_t** data, size_t* size)
+{
+    size_t capacity = IO_BLOCK_SIZE;
+    long start = ftell(inFile);
+    if((start >= 0) && (fseek(inFile, 0, SEEK_END) == 0))
+    {
+        long end = ftell(inFile);
+        fseek(inFile, start, SEEK_SET);
+
+        /* one byte more than the size lets the same fread see the end of file */
+        if(end >= start)
+            capacity = (size_t)(end - start) + 1;
+    }
+
+    *data = new (std::nothrow) byte_t[capacity];
+    *size = 0;
+    if(*data == nullptr)
+        return 0;
+
+    while((*size += fread(*data + *size, 1, capacity - *size, inFile)) == capacity)
+    {
+        byte_t* grown = new (std::nothrow) byte_t[2 * capacity];
+        if(grown == nullptr)
+        {
+            delete[] *data;
+            *data = nullptr;
+            errno = ENOMEM;
+            return -1;
+        }
+
+        memcpy(grown, *data, *size);
+        delete[] *data;
+        *data = grown;
+        capacity *= 2;
+    }
+
+    if(ferror(inFile))
+    {
+        delete[] *data;
+        *data = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+static int EncodeCanonicalFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const byte_t* codeLengths)
+{
+    uint32_t codes[NUM_CHARS];
+    MakeCanonicalCodes(codeLengths, codes);
+
+    WriteSignature(bOutFile, HUFFMAN_VERSION_CANONICAL);
+    WriteCanonicalHeader(codeLengths, bOutFile);
+
+    if(data != nullptr)
+    {
+        for(size_t i = 0; i < size; i++)
+            BitFileWriteBits(bOutFile, codes[data[i]], codeLengths[data[i]]);
+    }
+    else
+    {
+        rewind(inFile);
+        int c;
+        while((c = fgetc(inFile)) != EOF)
+            BitFileWriteBits(bOutFile, codes[c], codeLengths[c]);
+    }
+
+    BitFileWriteBits(bOutFile, codes[EOF_CHAR], codeLengths[EOF_CHAR]);
+    return 0;
+}
+
+/*
+* The input is cut into blocks of INTERLEAVED_BLOCK_SIZE symbols and every
+* block into numStreams equal segments, the last one taking what is left.
+* Each segment is coded as its own byte aligned sub-stream. A block starts
+* with the byte sizes of its sub-streams, so the decoder finds all of them
+* before decoding any. The symbol count in the header replaces EOF_CHAR.
+*/
+static int EncodeInterleavedFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const byte_t* codeLengths,
+    int numStreams)
+{
+    /* the symbol count goes into a count_t */
+    if(size >= COUNT_T_MAX)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    uint32_t codes[NUM_CHARS];
+    MakeCanonicalCodes(codeLengths, codes);
+
+    /* sub-streams go through buffer on their way to a FILE, into memory they are coded in place */
+    unsigned char* buffer = nullptr;
+    if(inFile != nullptr)
+    {
+        buffer = new (std::nothrow) unsigned char[INTERLEAVED_BUFFER_SIZE];
+        if(buffer == nullptr)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    WriteSignature(bOutFile, HUFFMAN_VERSION_INTERLEAVED);
+    WriteCanonicalHeader(codeLengths, bOutFile);
+    BitFilePutChar(numStreams, bOutFile);
+    count_t numSymbols = (count_t)size;
+    BitFilePutBitsNum(bOutFile, &numSymbols, 8 * sizeof(count_t), sizeof(count_t));
+
+    for(size_t blockStart = 0; blockStart < size; blockStart += INTERLEAVED_BLOCK_SIZE)
+    {
+        size_t blockLen = size - blockStart;
+        if(blockLen > INTERLEAVED_BLOCK_SIZE)
+            blockLen = INTERLEAVED_BLOCK_SIZE;
+
+        EncodeInterleavedBlock(data + blockStart, blockLen, codeLengths, codes, numStreams, buffer, bOutFile);
+    }
+
+    delete[] buffer;
+    return 0;
+}
+
+/*
+* Jump table and sub-streams of one block. The sub-streams are coded in
+* buffer, which takes INTERLEAVED_BOUND(blockLen) bytes, or in place when
+* buffer is nullptr and bOutFile is over memory.
+*/
+static void EncodeInterleavedBlock(const byte_t* block, size_t blockLen, const byte_t* codeLengths, const uint32_t* codes,
+    int numStreams, unsigned char* buffer, bit_file_t* bOutFile)
+{
+    const byte_t* segments[MAX_STREAMS + 1];
+    SplitBlock(block, blockLen, numStreams, segments);
+
+    count_t streamSizes[MAX_STREAMS];
+    size_t totalSize = 0;
+    for(int s = 0; s < numStreams; s++)
+    {
+        uint64_t bits = 0;
+        for(const byte_t* p = segments[s]; p < segments[s + 1]; p++)
+            bits += codeLengths[*p];
+        streamSizes[s] = (count_t)((bits + 7) / 8);
+        totalSize += streamSizes[s];
+
+        BitFilePutBitsNum(bOutFile, &streamSizes[s], 8 * sizeof(count_t), sizeof(count_t));
+    }
+
+    unsigned char* coded = (buffer != nullptr) ? buffer : BitFileBufferBytes(bOutFile, totalSize);
+    if(coded == nullptr)
+        return;     /* out of room, the bit file has its error set */
+
+    size_t offset = 0;
+    for(int s = 0; s < numStreams; s++)
+    {
+        bit_file_t stream;
+        InitBitBuffer(&stream, coded + offset, streamSizes[s], BF_WRITE);
+        for(const byte_t* p = segments[s]; p < segments[s + 1]; p++)
+            BitFileWriteBits(&stream, codes[*p], codeLengths[*p]);
+        CloseBitBuffer(&stream);
+        offset += streamSizes[s];
+    }
+
+    if(buffer != nullptr)
+        BitFilePutBytes(bOutFile, buffer, totalSize);
+}
+
+typedef struct block_job_t
+{
+    const byte_t* data;
+    size_t size;
+    size_t blockSize;
+    int numStreams;
+    int maxCodeLen;
+
+    /* one entry per block, a coded entry of nullptr when its buffer could not be allocated */
+    unsigned char** coded;
+    count_t* codedSizes;
+} block_job_t;
+
+static void EncodeBlockJob(void* context, int index)
+{
+    block_job_t* job = (block_job_t*)context;
+    const byte_t* block = job->data + (size_t)index * job->blockSize;
+    size_t blockLen = job->size - (size_t)index * job->blockSize;
+    if(blockLen > job->blockSize)
+        blockLen = job->blockSize;
+
+    size_t bound = BLOCK_HEADER_BOUND + INTERLEAVED_BOUND(blockLen);
+    unsigned char* coded = new (std::nothrow) unsigned char[bound];
+    job->coded[index] = coded;
+    if(coded == nullptr)
+        return;
+
+    bit_file_t bfp;
+    InitBitBuffer(&bfp, coded, bound, BF_WRITE);
+    EncodeCodedBlock(block, blockLen, job->numStreams, job->maxCodeLen, &bfp);
+    job->codedSizes[index] = (count_t)CloseBitBuffer(&bfp);
+}
+
+/* code lengths and interleaved block of one block, into a bit file over memory */
+static void EncodeCodedBlock(const byte_t* block, size_t blockLen, int numStreams, int maxCodeLen, bit_file_t* bfp)
+{
+    /* a block is smaller than MAX_BLOCK_SIZE, its counts can not overflow */
+    count_t counts[NUM_CHARS];
+    CountBufferSymbols(block, blockLen, counts);
+    byte_t codeLengths[NUM_CHARS];
+    MakeFileCodeLengths(counts, maxCodeLen, codeLengths);
+    uint32_t codes[NUM_CHARS];
+    MakeCanonicalCodes(codeLengths, codes);
+
+    WriteCanonicalHeader(codeLengths, bfp);
+    EncodeInterleavedBlock(block, blockLen, codeLengths, codes, numStreams, nullptr, bfp);
+}
+
+/*
+* Every block of blockSize symbols gets its own code lengths and an
+* interleaved block of numStreams sub-streams, so blocks are coded and
+* decoded on their own. After the signature come the number of
+* sub-streams, the block size, the symbol count and the index of coded
+* block sizes, then the blocks in order. Nothing depends on which thread
+* coded a block, so the output is the same for any number of threads.
+*/
+static int EncodeBlockFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile, const huffman_options_t* options,
+    int maxCodeLen)
+{
+    /* the symbol count goes into a count_t, and blocks of at least MIN_BLOCK_SIZE then number fewer than INT_MAX */
+    if(size >= COUNT_T_MAX)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    int numStreams = (options->numStreams != 0) ? options->numStreams : 1;
+    int numBlocks = (int)((size + options->blockSize - 1) / options->blockSize);
+
+    WriteSignature(bOutFile, HUFFMAN_VERSION_BLOCKS);
+    BitFilePutChar(numStreams, bOutFile);
+    count_t blockSize = (count_t)options->blockSize;
+    BitFilePutBitsNum(bOutFile, &blockSize, 8 * sizeof(count_t), sizeof(count_t));
+    count_t numSymbols = (count_t)size;
+    BitFilePutBitsNum(bOutFile, &numSymbols, 8 * sizeof(count_t), sizeof(count_t));
+
+    if(inFile == nullptr)
+        return EncodeBlockBuffer(data, size, bOutFile, numStreams, blockSize, maxCodeLen, numBlocks);
+
+    block_job_t job;
+    job.data = data;
+    job.size = size;
+    job.blockSize = blockSize;
+    job.numStreams = numStreams;
+    job.maxCodeLen = maxCodeLen;
+    job.coded = new (std::nothrow) unsigned char*[numBlocks + 1];
+    job.codedSizes = new (std::nothrow) count_t[numBlocks + 1];
+    if((job.coded == nullptr) || (job.codedSizes == nullptr))
+    {
+        delete[] job.coded;
+        delete[] job.codedSizes;
+        errno = ENOMEM;
+        return -1;
+    }
+    ParallelFor(numBlocks, options->numThreads, EncodeBlockJob, &job);
+
+    bool allocated = true;
+    for(int i = 0; i < numBlocks; i++)
+        allocated = allocated && (job.coded[i] != nullptr);
+
+    if(!allocated)
+    {
+        for(int i = 0; i < numBlocks; i++)
+            delete[] job.coded[i];
+        delete[] job.coded;
+        delete[] job.codedSizes;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(int i = 0; i < numBlocks; i++)
+        BitFilePutBitsNum(bOutFile, &job.codedSizes[i], 8 * sizeof(count_t), sizeof(count_t));
+
+    for(int i = 0; i < numBlocks; i++)
+    {
+        BitFilePutBytes(bOutFile, job.coded[i], job.codedSizes[i]);
+        delete[] job.coded[i];
+    }
+
+    delete[] job.coded;
+    delete[] job.codedSizes;
+    return 0;
+}
+
+/*
+* Blocks coded one after another on the calling thread straight into a bit
+* file over memory, their sizes go into the index left in front of them.
+*/
+static int EncodeBlockBuffer(const byte_t* data, size_t size, bit_file_t* bOutFile, int numStreams, size_t blockSize,
+    int maxCodeLen, int numBlocks)
+{
+    size_t indexSize = (size_t)numBlocks * sizeof(count_t);
+    unsigned char* index = BitFileBufferBytes(bOutFile, indexSize);
+    if(index == nullptr)
+        return 0;   /* out of room, the bit file has its error set */
+
+    bit_file_t bIndex;
+    InitBitBuffer(&bIndex, index, indexSize, BF_WRITE);
+    for(int i = 0; i < numBlocks; i++)
+    {
+        size_t blockLen = size - (size_t)i * blockSize;
+        if(blockLen > blockSize)
+            blockLen = blockSize;
+
+        const unsigned char* start = BitFileBufferBytes(bOutFile, 0);
+        EncodeCodedBlock(data + (size_t)i * blockSize, blockLen, numStreams, maxCodeLen, bOutFile);
+        const unsigned char* end = BitFileBufferBytes(bOutFile, 0);
+        if((start == nullptr) || (end == nullptr))
+            return 0;
+
+        count_t codedSize = (count_t)(end - start);
+        BitFilePutBitsNum(&bIndex, &codedSize, 8 * sizeof(count_t), sizeof(count_t));
+    }
+    CloseBitBuffer(&bIndex);
+    return 0;
+}
+
+/* code of a node of the adaptive tree, the path from the root */
+static void PutAdaptiveCode(const adaptive_tree_t* tree, int node, bit_file_t* bfp)
+{
+    byte_t path[ADAPTIVE_NODES];
+    int depth = 0;
+    while(node != ADAPTIVE_ROOT)
+    {
+        int parent = tree->nodes[node].parent;
+        path[depth++] = (tree->nodes[parent].right == node);
+        node = parent;
+    }
+
+    while(depth > 0)
+        BitFileWriteBits(bfp, path[--depth], 1);
+}
+
+/*
+* One pass over the input in blocks, so it may be a pipe, or over data when
+* inFile is nullptr. A symbol seen before is sent with its code in the
+* adaptive tree, a new one with the code of the NYT leaf and
+* ADAPTIVE_SYMBOL_BITS plain bits. EOF_CHAR is sent the same way at the end.
+*/
+static int EncodeAdaptiveFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile)
+{
+    WriteSignature(bOutFile, HUFFMAN_VERSION_ADAPTIVE);
+
+    adaptive_tree_t tree;
+    InitAdaptiveTree(&tree);
+    int status = 0;
+    if(inFile == nullptr)
+    {
+        EncodeAdaptiveSymbols(&tree, data, size, bOutFile);
+    }
+    else
+    {
+        byte_t* inBlock = new byte_t[IO_BLOCK_SIZE];
+        size_t inLen;
+        while((inLen = fread(inBlock, 1, IO_BLOCK_SIZE, inFile)) != 0)
+            EncodeAdaptiveSymbols(&tree, inBlock, inLen, bOutFile);
+
+        status = ferror(inFile) ? -1 : 0;
+        delete[] inBlock;
+    }
+
+    PutAdaptiveCode(&tree, tree.nyt, bOutFile);
+    BitFileWriteBits(bOutFile, EOF_CHAR, ADAPTIVE_SYMBOL_BITS);
+    return status;
+}
+
+static void EncodeAdaptiveSymbols(adaptive_tree_t* tree, const byte_t* symbols, size_t len, bit_file_t* bOutFile)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        int node = tree->leaves[symbols[i]];
+        if(node != NONE)
+        {
+            PutAdaptiveCode(tree, node, bOutFile);
+        }
+        else
+        {
+            PutAdaptiveCode(tree, tree->nyt, bOutFile);
+            BitFileWriteBits(bOutFile, symbols[i], ADAPTIVE_SYMBOL_BITS);
+        }
+        UpdateAdaptiveTree(tree, symbols[i]);
+    }
+}
+
+/*
+* The codes come from the dictionary, so the stream names it by its id in
+* place of a header and the input is coded in a single pass.
+*/
+static int EncodeDictionaryFile(FILE* inFile, const byte_t* data, size_t size, bit_file_t* bOutFile,
+    const dictionary_t* dictionary)
+{
+    const byte_t* codeLengths = dictionary->codeLengths;
+    uint32_t codes[NUM_CHARS];
+    MakeCanonicalCodes(codeLengths, codes);
+
+    WriteSignature(bOutFile, HUFFMAN_VERSION_DICTIONARY);
+    BitFileWriteBits(bOutFile, dictionary->id, 32);
+
+    int status = 0;
+    if(inFile == nullptr)
+    {
+        for(size_t i = 0; i < size; i++)
+            BitFileWriteBits(bOutFile, codes[data[i]], codeLengths[data[i]]);
+    }
+    else
+    {
+        byte_t* inBlock = new byte_t[IO_BLOCK_SIZE];
+        size_t inLen;
+        while((inLen = fread(inBlock, 1, IO_BLOCK_SIZE, inFile)) != 0)
+        {
+            for(size_t i = 0; i < inLen; i++)
+                BitFileWriteBits(bOutFile, codes[inBlock[i]], codeLengths[inBlock[i]]);
+        }
+
+        status = ferror(inFile) ? -1 : 0;
+        delete[] inBlock;
+    }
+
+    BitFileWriteBits(bOutFile, codes[EOF_CHAR], codeLengths[EOF_CHAR]);
+    return status;
+}
+
+/* segments[s] to segments[s + 1] is the part of the block sub-stream s codes */
+static void SplitBlock(const byte_t* block, size_t blockLen, int numStreams, const byte_t** segments)
+{
+    size_t segmentLen = (blockLen + numStreams - 1) / numStreams;
+    for(int s = 0; s < numStreams; s++)
+        segments[s] = block + ((s * segmentLen < blockLen) ? s * segmentLen : blockLen);
+    segments[numStreams] = block + blockLen;
+}
+
+int HuffmanDecodeFile(FILE* inFile, FILE* outFile, const huffman_options_t* options)
+{
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    bit_file_t* bInFile = MakeBitFile(inFile, BF_READ);
+    if(nullptr == bInFile)
+    {
+        perror("Making Input File a BitFile");
+        return -1;
+    }
+
+    symbol_sink_t sink;
+    InitSink(&sink, outFile, nullptr, 0);
+    DECODE_STATUS status = DecodeInput(bInFile, &sink, options);
+    inFile = BitFileToFILE(bInFile);
+
+    switch(status)
+    {
+    case DECODE_OK:
+        return 0;
+    case DECODE_BAD_HEADER:
+        fprintf(stderr, "error: malformed file header.\n");
+        break;
+    case DECODE_BAD_VERSION:
+        fprintf(stderr, "error: unsupported stream version.\n");
+        break;
+    case DECODE_NO_DICTIONARY:
+        fprintf(stderr, "error: stream was coded with a dictionary that was not given.\n");
+        break;
+    case DECODE_NO_MEMORY:
+        fprintf(stderr, "error: out of memory.\n");
+        errno = ENOMEM;
+        return -1;
+    default:
+        fprintf(stderr, "error: malformed coded stream.\n");
+        break;
+    }
+    errno = EILSEQ;
+    return -1;
+}
+
+int HuffmanDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const huffman_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    bit_file_t bInFile;
+    InitBitBuffer(&bInFile, (unsigned char*)src, size, BF_READ);
+    symbol_sink_t sink;
+    InitSink(&sink, nullptr, dst, capacity);
+
+    DECODE_STATUS status = DecodeInput(&bInFile, &sink, options);
+    if(status != DECODE_OK)
+    {
+        errno = (status == DECODE_NO_ROOM) ? ENOSPC : (status == DECODE_NO_MEMORY) ? ENOMEM : EILSEQ;
+        return -1;
+    }
+
+    *dstSize = sink.len;
+    return 0;
+}
+
+static DECODE_STATUS DecodeInput(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options)
+{
+    int c = BitFileGetChar(bInFile);
+    count_t count = 0;
+    if((c == EOF) || (BitFileGetBits(bInFile, (void *)(&count), 8 * sizeof(count_t)) == EOF))
+        return DECODE_BAD_HEADER;
+
+    if((c != HUFFMAN_MAGIC) || (count != 0))
+        return DecodeTreeFile(bInFile, c, count, sink);
+
+    switch(BitFileGetChar(bInFile))
+    {
+    case HUFFMAN_VERSION_CANONICAL:
+        return DecodeCanonicalFile(bInFile, sink);
+    case HUFFMAN_VERSION_INTERLEAVED:
+        return DecodeInterleavedFile(bInFile, sink);
+    case HUFFMAN_VERSION_BLOCKS:
+        return DecodeBlockFile(bInFile, sink, options);
+    case HUFFMAN_VERSION_ADAPTIVE:
+        return DecodeAdaptiveFile(bInFile, sink);
+    case HUFFMAN_VERSION_DICTIONARY:
+        return DecodeDictionaryFile(bInFile, sink, options);
+    default:
+        return DECODE_BAD_VERSION;
+    }
+}
+
+static DECODE_STATUS DecodeTreeFile(bit_file_t* bInFile, int c, count_t count, symbol_sink_t* sink)
+{
+    count_t counts[NUM_CHARS];
+    if(0 != ReadHeader(counts, bInFile, c, count))
+        return DECODE_BAD_HEADER;
+
+    huffman_tree_t huffmanTree;
+    BuildHuffmanTree(&huffmanTree, counts);
+
+    decode_table_t decodeTable;
+    BuildDecodeTable(&decodeTable, &huffmanTree);
+    return DecodeStream(&huffmanTree, &decodeTable, bInFile, sink);
+}
+
+static DECODE_STATUS DecodeCanonicalFile(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    byte_t codeLengths[NUM_CHARS];
+    decode_table_t decodeTable;
+    if((0 != ReadCanonicalHeader(codeLengths, bInFile)) || (0 != BuildCanonicalDecodeTable(&decodeTable, codeLengths)))
+        return DECODE_BAD_HEADER;
+
+    return DecodeStream(nullptr, &decodeTable, bInFile, sink);
+}
+
+static DECODE_STATUS DecodeInterleavedFile(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    byte_t codeLengths[NUM_CHARS];
+    if(0 != ReadCanonicalHeader(codeLengths, bInFile))
+        return DECODE_BAD_HEADER;
+
+    int numStreams = BitFileGetChar(bInFile);
+    count_t numSymbols = 0;
+    decode_table_t decodeTable;
+    if((numStreams < 1) || (numStreams > MAX_STREAMS)
+        || (BitFileGetBitsNum(bInFile, &numSymbols, 8 * sizeof(count_t), sizeof(count_t)) == EOF)
+        || (0 != BuildCanonicalDecodeTable(&decodeTable, codeLengths)))
+    {
+        return DECODE_BAD_HEADER;
+    }
+
+    /* a FILE is read and written through scratch blocks, memory is decoded in place */
+    unsigned char* buffer = nullptr;
+    byte_t* block = nullptr;
+    if(sink->fp != nullptr)
+    {
+        buffer = new unsigned char[INTERLEAVED_BUFFER_SIZE];
+        block = new byte_t[INTERLEAVED_BLOCK_SIZE];
+    }
+
+    DECODE_STATUS status = DECODE_OK;
+    for(count_t remaining = numSymbols; (remaining > 0) && (status == DECODE_OK);)
+    {
+        size_t blockLen = (remaining < INTERLEAVED_BLOCK_SIZE) ? remaining : INTERLEAVED_BLOCK_SIZE;
+        remaining -= (count_t)blockLen;
+
+        byte_t* out = (block != nullptr) ? block : SinkReserve(sink, blockLen);
+        if(out == nullptr)
+        {
+            status = DECODE_NO_ROOM;
+            break;
+        }
 
-static int MakeCodeList(huffman_node_t* ht, code_list_t* codeList);
+        status = DecodeInterleavedData(&decodeTable, numStreams, bInFile, buffer, INTERLEAVED_BUFFER_SIZE, out, blockLen);
+        if((status == DECODE_OK) && (out == block))
+            status = (SinkWrite(sink, block, blockLen) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    }
 
-static void WriteHeader(huffman_node_t* ht, bit_file_t* bfp);
-static int ReadHeader(huffman_node_t** ht, bit_file_t* bfp);
+    delete[] block;
+    delete[] buffer;
+    return status;
+}
 
-int HuffmanEncodeFile(FILE* inFile, FILE* outFile)
+/*
+* Reads the jump table and sub-streams of one block and decodes them. The
+* sub-streams are read into buffer, or used in place when buffer is nullptr
+* and bInFile is over memory.
+*/
+static DECODE_STATUS DecodeInterleavedData(const decode_table_t* table, int numStreams, bit_file_t* bInFile,
+    unsigned char* buffer, size_t bufferSize, byte_t* block, size_t blockLen)
 {
-    if((nullptr == inFile) || (nullptr == outFile))
+    count_t streamSizes[MAX_STREAMS];
+    size_t totalSize = 0;
+    bool valid = true;
+    for(int s = 0; valid && (s < numStreams); s++)
     {
-        errno = ENOENT;
-        return -1;
+        valid = (BitFileGetBitsNum(bInFile, &streamSizes[s], 8 * sizeof(count_t), sizeof(count_t)) != EOF);
+        totalSize += streamSizes[s];
     }
 
-    bit_file_t* bOutFile = MakeBitFile(outFile, BF_WRITE);
+    const unsigned char* coded = nullptr;
+    if(valid && (buffer == nullptr))
+        coded = BitFileBufferBytes(bInFile, totalSize);
+    else if(valid && (totalSize <= bufferSize) && (BitFileGetBytes(bInFile, buffer, totalSize) == totalSize))
+        coded = buffer;
 
-    if(nullptr == bOutFile)
+    if(coded == nullptr)
+        return DECODE_BAD_STREAM;
+
+    bit_file_t streamFiles[MAX_STREAMS];
+    bit_file_t* streams[MAX_STREAMS];
+    size_t offset = 0;
+    for(int s = 0; s < numStreams; s++)
     {
-        perror("Making Output File a BitFile");
-        return -1;
+        InitBitBuffer(&streamFiles[s], (unsigned char*)coded + offset, streamSizes[s], BF_READ);
+        streams[s] = &streamFiles[s];
+        offset += streamSizes[s];
+    }
+
+    if(0 != DecodeInterleavedBlock(table, streams, numStreams, block, blockLen))
+        return DECODE_BAD_STREAM;
+    return DECODE_OK;
+}
+
+typedef struct block_decode_job_t
+{
+    int numStreams;
+    size_t blockSize;
+
+    /* coded and decoded blocks of the batch, one after another */
+    unsigned char* coded;
+    const size_t* codedOffsets;
+    byte_t* decoded;
+    const size_t* blockLens;
+    int* status;
+} block_decode_job_t;
+
+static void DecodeBlockJob(void* context, int index)
+{
+    block_decode_job_t* job = (block_decode_job_t*)context;
+    size_t codedSize = job->codedOffsets[index + 1] - job->codedOffsets[index];
+    bit_file_t bfp;
+    InitBitBuffer(&bfp, job->coded + job->codedOffsets[index], codedSize, BF_READ);
+    job->status[index] = DecodeCodedBlock(&bfp, job->numStreams, job->decoded + (size_t)index * job->blockSize,
+        job->blockLens[index]);
+}
+
+/* code lengths and interleaved block of one block, from a bit file over memory */
+static DECODE_STATUS DecodeCodedBlock(bit_file_t* bfp, int numStreams, byte_t* block, size_t blockLen)
+{
+    byte_t codeLengths[NUM_CHARS];
+    decode_table_t decodeTable;
+    if((0 != ReadCanonicalHeader(codeLengths, bfp)) || (0 != BuildCanonicalDecodeTable(&decodeTable, codeLengths)))
+        return DECODE_BAD_STREAM;
+
+    return DecodeInterleavedData(&decodeTable, numStreams, bfp, nullptr, 0, block, blockLen);
+}
+
+/*
+* Blocks are read BLOCK_BATCH at a time, decoded on the thread pool and
+* written in order.
+*/
+static DECODE_STATUS DecodeBlockFile(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options)
+{
+    int numStreams = BitFileGetChar(bInFile);
+    count_t blockSize = 0;
+    count_t numSymbols = 0;
+    if((numStreams < 1) || (numStreams > MAX_STREAMS)
+        || (BitFileGetBitsNum(bInFile, &blockSize, 8 * sizeof(count_t), sizeof(count_t)) == EOF)
+        || (BitFileGetBitsNum(bInFile, &numSymbols, 8 * sizeof(count_t), sizeof(count_t)) == EOF)
+        || (blockSize < MIN_BLOCK_SIZE) || (blockSize > MAX_BLOCK_SIZE))
+    {
+        return DECODE_BAD_HEADER;
     }
 
-    huffman_node_t* huffmanTree = GenerateTreeFromFile(inFile);
-    if(huffmanTree == nullptr)
+    int numBlocks = (int)(((uint64_t)numSymbols + blockSize - 1) / blockSize);
+    if(sink->fp == nullptr)
+        return DecodeBlockBuffer(bInFile, sink, numStreams, blockSize, numSymbols, numBlocks);
+
+    count_t* codedSizes = new (std::nothrow) count_t[numBlocks + 1];
+    if(codedSizes == nullptr)
+        return DECODE_NO_MEMORY;
+
+    bool valid = true;
+    for(int i = 0; valid && (i < numBlocks); i++)
     {
-        outFile = BitFileToFILE(bOutFile);
-        return -1;
+        valid = (BitFileGetBitsNum(bInFile, &codedSizes[i], 8 * sizeof(count_t), sizeof(count_t)) != EOF)
+            && (codedSizes[i] <= BLOCK_HEADER_BOUND + INTERLEAVED_BOUND(blockSize));
     }
 
-    
-    code_list_t codeList[NUM_CHARS];
-    for(int i = 0; i < NUM_CHARS; i++)
+    if(!valid)
     {
-        codeList[i].code = nullptr;
-        codeList[i].codeLen = 0;
+        delete[] codedSizes;
+        return DECODE_BAD_HEADER;
     }
 
-    if(0 != MakeCodeList(huffmanTree, codeList))
+    /* the header says how big blocks are, a stream of fewer symbols only needs room for those */
+    block_decode_job_t job;
+    job.numStreams = numStreams;
+    job.blockSize = blockSize;
+    job.decoded = new (std::nothrow) byte_t[(size_t)((numBlocks < BLOCK_BATCH) ? numBlocks : BLOCK_BATCH) *
+        ((numSymbols < blockSize) ? numSymbols : blockSize)];
+    if(job.decoded == nullptr)
     {
-        outFile = BitFileToFILE(bOutFile);
-        return -1;
+        delete[] codedSizes;
+        return DECODE_NO_MEMORY;
     }
+    size_t codedOffsets[BLOCK_BATCH + 1];
+    size_t blockLens[BLOCK_BATCH];
+    int blockStatus[BLOCK_BATCH];
+    job.codedOffsets = codedOffsets;
+    job.blockLens = blockLens;
+    job.status = blockStatus;
+    job.coded = nullptr;
+
+    DECODE_STATUS status = DECODE_OK;
+    for(int first = 0; (first < numBlocks) && (status == DECODE_OK); first += BLOCK_BATCH)
+    {
+        int batch = (numBlocks - first < BLOCK_BATCH) ? numBlocks - first : BLOCK_BATCH;
+        size_t decodedSize = 0;
+        codedOffsets[0] = 0;
+        for(int i = 0; i < batch; i++)
+        {
+            codedOffsets[i + 1] = codedOffsets[i] + codedSizes[first + i];
+            blockLens[i] = numSymbols - (size_t)(first + i) * blockSize;
+            if(blockLens[i] > blockSize)
+                blockLens[i] = blockSize;
+            decodedSize += blockLens[i];
+        }
 
-    WriteHeader(huffmanTree, bOutFile);
-    rewind(inFile);
-    int c;
-    while((c = fgetc(inFile)) != EOF)
-        BitFilePutBits(bOutFile, BitArrayGetBits(codeList[c].code), codeList[c].codeLen);
+        delete[] job.coded;
+        job.coded = new (std::nothrow) unsigned char[codedOffsets[batch] + 1];
+        if(job.coded == nullptr)
+        {
+            status = DECODE_NO_MEMORY;
+            break;
+        }
+        if(BitFileGetBytes(bInFile, job.coded, codedOffsets[batch]) != codedOffsets[batch])
+        {
+            status = DECODE_BAD_STREAM;
+            break;
+        }
 
-    BitFilePutBits(bOutFile, BitArrayGetBits(codeList[EOF_CHAR].code), codeList[EOF_CHAR].codeLen);
+        ParallelFor(batch, (options != nullptr) ? options->numThreads : 0, DecodeBlockJob, &job);
+        for(int i = 0; i < batch; i++)
+        {
+            if(blockStatus[i] != DECODE_OK)
+                status = (DECODE_STATUS)blockStatus[i];
+        }
 
-    for(int i = 0; i < NUM_CHARS; i++)
-        if(codeList[i].code != nullptr)
-            BitArrayDestroy(codeList[i].code);
+        if(status == DECODE_OK)
+            status = (SinkWrite(sink, job.decoded, decodedSize) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+    }
 
-    outFile = BitFileToFILE(bOutFile);
-    FreeHuffmanTree(huffmanTree);
-    return 0;
+    delete[] job.coded;
+    delete[] job.decoded;
+    delete[] codedSizes;
+    return status;
 }
 
-int HuffmanDecodeFile(FILE* inFile, FILE* outFile)
+/* the blocks of a block stream in memory, decoded in place one after another on the calling thread */
+static DECODE_STATUS DecodeBlockBuffer(bit_file_t* bInFile, symbol_sink_t* sink, int numStreams, size_t blockSize,
+    count_t numSymbols, int numBlocks)
 {
-    if((nullptr == inFile) || (nullptr == outFile))
-    {
-        errno = ENOENT;
-        return -1;
-    }
+    size_t indexSize = (size_t)numBlocks * sizeof(count_t);
+    unsigned char* index = BitFileBufferBytes(bInFile, indexSize);
+    if(index == nullptr)
+        return DECODE_BAD_HEADER;
 
-    bit_file_t* bInFile = MakeBitFile(inFile, BF_READ);
-    if(nullptr == bInFile)
+    bit_file_t bIndex;
+    InitBitBuffer(&bIndex, index, indexSize, BF_READ);
+    for(int i = 0; i < numBlocks; i++)
     {
-        perror("Making Input File a BitFile");
-        return -1;
+        count_t codedSize = 0;
+        BitFileGetBitsNum(&bIndex, &codedSize, 8 * sizeof(count_t), sizeof(count_t));
+        size_t blockLen = numSymbols - (size_t)i * blockSize;
+        if(blockLen > blockSize)
+            blockLen = blockSize;
+
+        unsigned char* coded = BitFileBufferBytes(bInFile, codedSize);
+        if(coded == nullptr)
+            return DECODE_BAD_STREAM;
+
+        byte_t* block = SinkReserve(sink, blockLen);
+        if(block == nullptr)
+            return DECODE_NO_ROOM;
+
+        bit_file_t bfp;
+        InitBitBuffer(&bfp, coded, codedSize, BF_READ);
+        DECODE_STATUS status = DecodeCodedBlock(&bfp, numStreams, block, blockLen);
+        if(status != DECODE_OK)
+            return status;
     }
+    return DECODE_OK;
+}
 
-    huffman_node_t *huffmanArray[NUM_CHARS];
-    for(int i = 0; i < NUM_CHARS; i++)
+static DECODE_STATUS DecodeAdaptiveFile(bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    adaptive_tree_t tree;
+    InitAdaptiveTree(&tree);
+    byte_t outBlock[OUT_BLOCK_SIZE];
+    size_t outLen = 0;
+    DECODE_STATUS status = DECODE_BAD_STREAM;
+    while(true)
     {
-        if((huffmanArray[i] = AllocHuffmanNode(i)) == nullptr)
+        int node = ADAPTIVE_ROOT;
+        int bit = 0;
+        while((tree.nodes[node].left != NONE) && ((bit = BitFileGetBit(bInFile)) != EOF))
+            node = (bit != 0) ? tree.nodes[node].right : tree.nodes[node].left;
+        if(bit == EOF)
+            break;
+
+        int symbol = tree.nodes[node].symbol;
+        if(node == tree.nyt)
         {
-            for(i--; i >= 0; i--)
-                delete huffmanArray[i];
+            symbol = BitFilePeekBits(bInFile, ADAPTIVE_SYMBOL_BITS);
+            if(BitFileBitsAvailable(bInFile) < ADAPTIVE_SYMBOL_BITS)
+                break;
+            BitFileSkipBits(bInFile, ADAPTIVE_SYMBOL_BITS);
 
-            inFile = BitFileToFILE(bInFile);
-            return -1;
+            if(symbol == EOF_CHAR)
+            {
+                status = DECODE_OK;
+                break;
+            }
+
+            /* a symbol already in the tree is never sent again */
+            if((symbol > EOF_CHAR) || (tree.leaves[symbol] != NONE))
+                break;
+        }
+
+        outBlock[outLen++] = (byte_t)symbol;
+        if(outLen == OUT_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, outBlock, outLen) != 0)
+                return DECODE_NO_ROOM;
+            outLen = 0;
         }
+        UpdateAdaptiveTree(&tree, symbol);
     }
 
-    if(0 != ReadHeader(huffmanArray, bInFile))
-    {
-        for(int i = 0; i < NUM_CHARS; i++)
-            delete huffmanArray[i];
+    if(SinkWrite(sink, outBlock, outLen) != 0)
+        return DECODE_NO_ROOM;
+    return status;
+}
 
-        inFile = BitFileToFILE(bInFile);
-        return -1;
+/* the id has to match the dictionary of the options */
+static DECODE_STATUS DecodeDictionaryFile(bit_file_t* bInFile, symbol_sink_t* sink, const huffman_options_t* options)
+{
+    uint32_t id = BitFilePeekBits(bInFile, 32);
+    if(BitFileBitsAvailable(bInFile) < 32)
+        return DECODE_BAD_HEADER;
+    BitFileSkipBits(bInFile, 32);
+
+    if((options == nullptr) || (options->dictionary == nullptr) || (options->dictionary->id != id))
+        return DECODE_NO_DICTIONARY;
+
+    decode_table_t decodeTable;
+    if(0 != ValidDictionaryCodes(options->dictionary->codeLengths))
+        return DECODE_NO_DICTIONARY;
+    BuildCanonicalDecodeTable(&decodeTable, options->dictionary->codeLengths);
+    return DecodeStream(nullptr, &decodeTable, bInFile, sink);
+}
+
+static void FillDecodeTable(decode_table_t* table, const huffman_tree_t* tree, int node, unsigned int code, int depth)
+{
+    const huffman_node_t* ht = &tree->nodes[node];
+    if(ht->value != COMPOSITE_NODE)
+    {
+        unsigned int first = code << (DECODE_LOOKUP_BITS - depth);
+        unsigned int last = first + (1 << (DECODE_LOOKUP_BITS - depth));
+        for(unsigned int i = first; i < last; i++)
+        {
+            table->entries[i].symbols[0] = (unsigned short)ht->value;
+            table->entries[i].numSymbols = 1;
+            table->entries[i].bits = (unsigned char)depth;
+            table->entries[i].firstBits = (unsigned char)depth;
+        }
+        return;
     }
 
-    huffman_node_t *huffmanTree;
-    if((huffmanTree = BuildHuffmanTree(huffmanArray, NUM_CHARS)) == nullptr)
+    if(depth == DECODE_LOOKUP_BITS)
     {
-        FreeHuffmanTree(huffmanTree);
-        inFile = BitFileToFILE(bInFile);
-        return -1;
+        table->entries[code].numSymbols = 0;
+        table->entries[code].bits = DECODE_LOOKUP_BITS;
+        table->subtrees[code] = (short)node;
+        return;
     }
 
-    int c;
-    huffman_node_t* currentNode = huffmanTree;
-    while((c = BitFileGetBit(bInFile)) != EOF)
+    FillDecodeTable(table, tree, ht->left, code << 1, depth + 1);
+    FillDecodeTable(table, tree, ht->right, (code << 1) | 1, depth + 1);
+}
+
+static void PairDecodeEntries(decode_table_t* table);
+
+static void BuildDecodeTable(decode_table_t* table, const huffman_tree_t* tree)
+{
+    memset(table, 0, sizeof(decode_table_t));
+    if(tree->root < NUM_CHARS)
+        return;
+
+    FillDecodeTable(table, tree, tree->root, 0, 0);
+    PairDecodeEntries(table);
+}
+
+static void PairDecodeEntries(decode_table_t* table)
+{
+    /* let an entry also resolve the next symbol when its code fits in the remaining bits */
+    decode_entry_t single[DECODE_TABLE_SIZE];
+    memcpy(single, table->entries, sizeof(table->entries));
+    for(unsigned int i = 0; i < DECODE_TABLE_SIZE; i++)
     {
-        if(c != 0)
-            currentNode = currentNode->right;
-        else
-            currentNode = currentNode->left;
+        decode_entry_t* entry = &table->entries[i];
+        if((entry->numSymbols != 1) || (entry->symbols[0] == EOF_CHAR))
+            continue;
 
-        if(currentNode->value != COMPOSITE_NODE)
+        const decode_entry_t* next = &single[(i << entry->bits) & (DECODE_TABLE_SIZE - 1)];
+        if((next->numSymbols == 1) && (entry->bits + next->bits <= DECODE_LOOKUP_BITS))
         {
-            if(currentNode->value == EOF_CHAR)
-                break;
-
-            fputc(currentNode->value, outFile);
-            currentNode = huffmanTree;
+            entry->symbols[1] = next->symbols[0];
+            entry->numSymbols = 2;
+            entry->bits += next->bits;
         }
     }
-    inFile = BitFileToFILE(bInFile);
-    FreeHuffmanTree(huffmanTree);
-    return 0;
 }
 
-static int MakeCodeList(huffman_node_t* ht, code_list_t* codeList)
+static int BuildCanonicalDecodeTable(decode_table_t* table, const byte_t* codeLengths)
 {
-    bit_array_t* code;
-    if((code = BitArrayCreate(EOF_CHAR)) == nullptr)
+    memset(table, 0, sizeof(decode_table_t));
+
+    for(int c = 0; c < NUM_CHARS; c++)
     {
-        perror("Unable to allocate bit array");
-        return -1;
+        if(codeLengths[c] > table->maxCodeLen)
+            table->maxCodeLen = codeLengths[c];
+        table->lengthCount[codeLengths[c]]++;
     }
+    table->lengthCount[0] = 0;
 
-    BitArrayClearAll(code);
-    byte_t depth = 0;
-    while(true)
+    /* codes of one length are consecutive, each length starts past the shorter ones */
+    uint32_t code = 0;
+    unsigned short index = 0;
+    for(int len = 1; len <= MAX_CODE_LEN; len++)
+    {
+        code = (code + table->lengthCount[len - 1]) << 1;
+        table->firstCode[len] = code;
+        table->firstIndex[len] = index;
+        index += table->lengthCount[len];
+
+        if(code + table->lengthCount[len] > (1u << len))
+            return -1;
+    }
+
+    unsigned short nextIndex[MAX_CODE_LEN + 1];
+    memcpy(nextIndex, table->firstIndex, sizeof(nextIndex));
+    for(int c = 0; c < NUM_CHARS; c++)
     {
-        while(ht->left != nullptr)
+        int len = codeLengths[c];
+        if(len == 0)
+            continue;
+
+        unsigned short rank = nextIndex[len]++;
+        table->sortedSymbols[rank] = (unsigned short)c;
+        if(len > DECODE_LOOKUP_BITS)
+            continue;
+
+        code = table->firstCode[len] + (rank - table->firstIndex[len]);
+        unsigned int first = code << (DECODE_LOOKUP_BITS - len);
+        unsigned int last = first + (1 << (DECODE_LOOKUP_BITS - len));
+        for(unsigned int i = first; i < last; i++)
         {
-            BitArrayShiftLeft(code, 1);
-            ht = ht->left;
-            depth++;
+            table->entries[i].symbols[0] = (unsigned short)c;
+            table->entries[i].numSymbols = 1;
+            table->entries[i].bits = (unsigned char)len;
+            table->entries[i].firstBits = (unsigned char)len;
         }
+    }
+
+    PairDecodeEntries(table);
+    return 0;
+}
+
+static DECODE_STATUS DecodeStream(const huffman_tree_t* tree, const decode_table_t* table, bit_file_t* bInFile, symbol_sink_t* sink)
+{
+    /* a lone EOF_CHAR leaf has an empty code, so there is nothing to decode */
+    if((tree != nullptr) && (tree->root < NUM_CHARS))
+        return DECODE_OK;
+
+    byte_t outBlock[OUT_BLOCK_SIZE + 1];
+    size_t outLen = 0;
+    while(true)
+    {
+        unsigned int index = BitFilePeekBits(bInFile, DECODE_LOOKUP_BITS);
+        unsigned int available = BitFileBitsAvailable(bInFile);
+        if(available == 0)
+            break;
 
-        if(ht->value != COMPOSITE_NODE)
+        const decode_entry_t* entry = &table->entries[index];
+        int symbol;
+        if(entry->numSymbols != 0)
         {
-            codeList[ht->value].codeLen = depth;
-            codeList[ht->value].code = BitArrayDuplicate(code);
-            if(codeList[ht->value].code == nullptr)
+            if(entry->bits <= available)
+            {
+                BitFileSkipBits(bInFile, entry->bits);
+                symbol = entry->symbols[0];
+                if(entry->numSymbols == 2)
+                {
+                    outBlock[outLen++] = (unsigned char)symbol;
+                    symbol = entry->symbols[1];
+                }
+            }
+            else if(entry->firstBits <= available)
+            {
+                BitFileSkipBits(bInFile, entry->firstBits);
+                symbol = entry->symbols[0];
+            }
+            else
             {
-                perror("Unable to allocate bit array");
-                BitArrayDestroy(code);
-                return -1;
+                /* a code cut by the end of the stream is dropped, as a bit by bit walk would */
+                break;
             }
-            BitArrayShiftLeft(codeList[ht->value].code, EOF_CHAR - depth);
         }
-
-        while(ht->parent != nullptr)
+        else if(tree == nullptr)
         {
-            if(ht != ht->parent->right)
+            int len;
+            uint32_t code = 0;
+            for(len = DECODE_LOOKUP_BITS + 1; len <= table->maxCodeLen; len++)
             {
-                BitArraySetBit(code, (EOF_CHAR - 1));
-                ht = ht->parent->right;
-                break;
+                code = BitFilePeekBits(bInFile, len);
+                if(code - table->firstCode[len] < table->lengthCount[len])
+                    break;
             }
-            else
+
+            /* not a code of the table, or one cut by the end of the stream */
+            if((len > table->maxCodeLen) || (len > (int)BitFileBitsAvailable(bInFile)))
+                break;
+
+            BitFileSkipBits(bInFile, len);
+            symbol = table->sortedSymbols[table->firstIndex[len] + (code - table->firstCode[len])];
+        }
+        else
+        {
+            if(available < DECODE_LOOKUP_BITS)
+                break;
+
+            BitFileSkipBits(bInFile, DECODE_LOOKUP_BITS);
+
+            const huffman_node_t* currentNode = &tree->nodes[table->subtrees[index]];
+            int bit;
+            while((currentNode->value == COMPOSITE_NODE) && ((bit = BitFileGetBit(bInFile)) != EOF))
             {
-                depth--;
-                BitArrayShiftRight(code, 1);
-                ht = ht->parent;
+                if(bit != 0)
+                    currentNode = &tree->nodes[currentNode->right];
+                else
+                    currentNode = &tree->nodes[currentNode->left];
             }
+            symbol = currentNode->value;
+            if(symbol == COMPOSITE_NODE)
+                break;
         }
-        if(ht->parent == nullptr)
+
+        if(symbol == EOF_CHAR)
             break;
+
+        outBlock[outLen++] = (unsigned char)symbol;
+        if(outLen >= OUT_BLOCK_SIZE)
+        {
+            if(SinkWrite(sink, outBlock, outLen) != 0)
+                return DECODE_NO_ROOM;
+            outLen = 0;
+        }
+    }
+
+    return (SinkWrite(sink, outBlock, outLen) == 0) ? DECODE_OK : DECODE_NO_ROOM;
+}
+
+/*
+* One lookup of a canonical table. Writes one symbol, or two when
+* allowPair is set and the entry has them; out must have room for two
+* either way, so the number of symbols is not branched on. Returns the
+* symbols written, or 0 for a code the table does not have. EOF_CHAR is
+* never coded and only shows up as 0x100 in invalid.
+*/
+static inline int DecodeCanonicalStep(const decode_table_t* table, bit_file_t* stream, byte_t* out, bool allowPair, unsigned int* invalid)
+{
+    const decode_entry_t* entry = &table->entries[BitFilePeekBits(stream, DECODE_LOOKUP_BITS)];
+    if(entry->numSymbols != 0)
+    {
+        out[0] = (byte_t)entry->symbols[0];
+        out[1] = (byte_t)entry->symbols[1];
+        if(allowPair)
+        {
+            *invalid |= entry->symbols[0] | entry->symbols[1];
+            BitFileSkipBits(stream, entry->bits);
+            return entry->numSymbols;
+        }
+
+        /* the second symbol may be the zero padding after the last code */
+        *invalid |= entry->symbols[0];
+        BitFileSkipBits(stream, entry->firstBits);
+        return 1;
+    }
+
+    for(int len = DECODE_LOOKUP_BITS + 1; len <= table->maxCodeLen; len++)
+    {
+        uint32_t code = BitFilePeekBits(stream, len);
+        if(code - table->firstCode[len] < table->lengthCount[len])
+        {
+            BitFileSkipBits(stream, len);
+            unsigned short symbol = table->sortedSymbols[table->firstIndex[len] + (code - table->firstCode[len])];
+            *invalid |= symbol;
+            out[0] = (byte_t)symbol;
+            return 1;
+        }
     }
-    BitArrayDestroy(code);
     return 0;
 }
 
-static void WriteHeader(huffman_node_t* ht, bit_file_t* bfp)
+/*
+* Steps of one sub-stream held in a local copy of its bit file, so the
+* compiler can keep it in registers across the four interleaved lanes.
+* A lane step expects DECODE_LOOKUP_BITS in the accumulator and room for
+* two symbols. An entry of a longer code has no symbols and zero bits, so
+* the lane stalls on it until a step on the real bit file decodes it.
+*/
+static inline void DecodeLaneStep(const decode_table_t* table, bit_file_t* lane, byte_t** out, unsigned int* invalid)
 {
-    while(true)
+    const decode_entry_t* entry = &table->entries[BitFileShowBits(lane, DECODE_LOOKUP_BITS)];
+    *invalid |= entry->symbols[0] | (entry->symbols[1] * (entry->numSymbols >> 1));
+    (*out)[0] = (byte_t)entry->symbols[0];
+    (*out)[1] = (byte_t)entry->symbols[1];
+    BitFileSkipBits(lane, entry->bits);
+    *out += entry->numSymbols;
+}
+
+static inline void RefillLane(bit_file_t* lane, bit_file_t* stream)
+{
+    if(!BitFileFillFromBlock(lane))
     {
-        while(ht->left != nullptr)
-            ht = ht->left;
+        *stream = *lane;
+        BitFileFill(stream);
+        *lane = *stream;
+    }
+}
+
+static inline void StallLaneStep(const decode_table_t* table, bit_file_t* lane, bit_file_t* stream, byte_t** out, unsigned int* invalid)
+{
+    if(table->entries[BitFileShowBits(lane, DECODE_LOOKUP_BITS)].numSymbols != 0)
+        return;
+
+    *stream = *lane;
+    int written = DecodeCanonicalStep(table, stream, *out, true, invalid);
+    *lane = *stream;
+    *out += written;
+    *invalid |= (written == 0) << 8;
+}
+
+/*
+* A round fills every lane to more than 56 bits and takes four lookups of at
+* most DECODE_LOOKUP_BITS from each, so no lookup tests the accumulator.
+* Rounds stop when a segment has less room than one round can write.
+*/
+static void DecodeFourStreams(const decode_table_t* table, bit_file_t** streams, byte_t** out, const byte_t** segments, unsigned int* invalid)
+{
+    const int roundRoom = 4 * 2 + 2;
+    bit_file_t lane0 = *streams[0], lane1 = *streams[1], lane2 = *streams[2], lane3 = *streams[3];
+    byte_t* out0 = out[0];
+    byte_t* out1 = out[1];
+    byte_t* out2 = out[2];
+    byte_t* out3 = out[3];
+    unsigned int laneInvalid = *invalid;
+    while(((laneInvalid & 0x100) == 0)
+        && (segments[1] - out0 >= roundRoom) && (segments[2] - out1 >= roundRoom)
+        && (segments[3] - out2 >= roundRoom) && (segments[4] - out3 >= roundRoom))
+    {
+        RefillLane(&lane0, streams[0]);
+        RefillLane(&lane1, streams[1]);
+        RefillLane(&lane2, streams[2]);
+        RefillLane(&lane3, streams[3]);
+        for(int step = 0; step < 4; step++)
+        {
+            DecodeLaneStep(table, &lane0, &out0, &laneInvalid);
+            DecodeLaneStep(table, &lane1, &out1, &laneInvalid);
+            DecodeLaneStep(table, &lane2, &out2, &laneInvalid);
+            DecodeLaneStep(table, &lane3, &out3, &laneInvalid);
+        }
+        StallLaneStep(table, &lane0, streams[0], &out0, &laneInvalid);
+        StallLaneStep(table, &lane1, streams[1], &out1, &laneInvalid);
+        StallLaneStep(table, &lane2, streams[2], &out2, &laneInvalid);
+        StallLaneStep(table, &lane3, streams[3], &out3, &laneInvalid);
+    }
+
+    *streams[0] = lane0;
+    *streams[1] = lane1;
+    *streams[2] = lane2;
+    *streams[3] = lane3;
+    out[0] = out0;
+    out[1] = out1;
+    out[2] = out2;
+    out[3] = out3;
+    *invalid = laneInvalid;
+}
+
+/*
+* The segments of a block have no data dependency on each other, so one
+* round takes a step in every sub-stream and the lookups overlap. Four
+* sub-streams, the usual layout, go through the register lanes first.
+* Rounds run while every segment has room for a pair; the ends are
+* finished one segment at a time. A sub-stream read past its end gets zero
+* bits, which only a corrupt file asks for.
+*/
+static int DecodeInterleavedBlock(const decode_table_t* table, bit_file_t** streams, int numStreams, byte_t* block, size_t blockLen)
+{
+    const byte_t* segments[MAX_STREAMS + 1];
+    SplitBlock(block, blockLen, numStreams, segments);
 
-        if((ht->value != COMPOSITE_NODE) && (ht->value != EOF_CHAR))
+    byte_t* out[MAX_STREAMS];
+    for(int s = 0; s < numStreams; s++)
+        out[s] = (byte_t*)segments[s];
+
+    unsigned int invalid = 0;
+    if(numStreams == 4)
+        DecodeFourStreams(table, streams, out, segments, &invalid);
+
+    while((invalid & 0x100) == 0)
+    {
+        size_t rounds = SIZE_MAX;
+        for(int s = 0; s < numStreams; s++)
         {
-            BitFilePutChar(ht->value, bfp);
-            BitFilePutBits(bfp, (void *)&(ht->count), 8 * sizeof(count_t));
+            size_t left = (size_t)(segments[s + 1] - out[s]) / 2;
+            if(left < rounds)
+                rounds = left;
         }
+        if(rounds == 0)
+            break;
 
-        while(ht->parent != nullptr)
+        for(; (rounds > 0) && ((invalid & 0x100) == 0); rounds--)
         {
-            if(ht != ht->parent->right)
-            {
-                ht = ht->parent->right;
-                break;
-            }
-            else
+            for(int s = 0; s < numStreams; s++)
             {
-                ht = ht->parent;
+                int written = DecodeCanonicalStep(table, streams[s], out[s], true, &invalid);
+                out[s] += written;
+                invalid |= (written == 0) << 8;
             }
         }
+    }
 
-        if(ht->parent == nullptr)
-            break;
+    for(int s = 0; s < numStreams; s++)
+    {
+        while(((invalid & 0x100) == 0) && (out[s] < segments[s + 1]))
+        {
+            byte_t pair[2];
+            int written = DecodeCanonicalStep(table, streams[s], pair, out[s] + 1 < segments[s + 1], &invalid);
+            memcpy(out[s], pair, written);
+            out[s] += written;
+            invalid |= (written == 0) << 8;
+        }
     }
 
-    BitFilePutChar(0, bfp);
-    for(int i = 0; i < sizeof(count_t); i++)
-        BitFilePutChar(0, bfp);
+    return ((invalid & 0x100) != 0) ? -1 : 0;
 }
 
-static int ReadHeader(huffman_node_t **ht, bit_file_t *bfp)
+static int ReadHeader(count_t* counts, bit_file_t *bfp, int c, count_t count)
 {
-    count_t count;
-    int c;
+    for(int i = 0; i < NUM_CHARS; i++)
+        counts[i] = 0;
+
     int status = -1;
-    while((c = BitFileGetChar(bfp)) != EOF)
+    while(c != EOF)
     {
-        BitFileGetBits(bfp, (void *)(&count), 8 * sizeof(count_t));
-
         if((count == 0) && (c == 0))
         {
             status = 0;
             break;
         }
 
-        ht[c]->count = count;
-        ht[c]->ignore = 0;
+        counts[c] = count;
+
+        if((c = BitFileGetChar(bfp)) != EOF)
+            BitFileGetBits(bfp, (void *)(&count), 8 * sizeof(count_t));
+    }
+
+    counts[EOF_CHAR] = 1;
+    return status;
+}
+
+static void PutNibble(bit_file_t* bfp, int nibble)
+{
+    BitFileWriteBits(bfp, nibble, 4);
+}
+
+static int GetNibble(bit_file_t* bfp)
+{
+    int nibble = BitFilePeekBits(bfp, 4);
+    if(BitFileBitsAvailable(bfp) < 4)
+        return EOF;
+
+    BitFileSkipBits(bfp, 4);
+    return nibble;
+}
+
+static void WriteSignature(bit_file_t* bfp, int version)
+{
+    BitFilePutChar(HUFFMAN_MAGIC, bfp);
+    for(size_t i = 0; i < sizeof(count_t); i++)
+        BitFilePutChar(0, bfp);
+    BitFilePutChar(version, bfp);
+}
+
+/*
+* Code lengths of all symbols as nibbles: 1 to 14 is the length of the next
+* symbol, LONG_LEN_NIBBLE followed by n is a length of 15 + n and 0 followed
+* by n marks n + 1 unused symbols. A trailing pad nibble keeps the header a
+* whole number of bytes.
+*/
+static void WriteCanonicalHeader(const byte_t* codeLengths, bit_file_t* bfp)
+{
+    int nibbles = 0;
+    for(int c = 0; c < NUM_CHARS;)
+    {
+        if(codeLengths[c] >= LONG_LEN_NIBBLE)
+        {
+            PutNibble(bfp, LONG_LEN_NIBBLE);
+            PutNibble(bfp, codeLengths[c] - LONG_LEN_NIBBLE);
+            nibbles += 2;
+            c++;
+            continue;
+        }
+
+        if(codeLengths[c] != 0)
+        {
+            PutNibble(bfp, codeLengths[c]);
+            nibbles++;
+            c++;
+            continue;
+        }
+
+        int run = 1;
+        while((c + run < NUM_CHARS) && (codeLengths[c + run] == 0) && (run < 16))
+            run++;
+
+        PutNibble(bfp, 0);
+        PutNibble(bfp, run - 1);
+        nibbles += 2;
+        c += run;
     }
 
-    ht[EOF_CHAR]->count = 1;
-    ht[EOF_CHAR]->ignore = 0;
+    if(nibbles % 2 != 0)
+        PutNibble(bfp, 0);
+}
 
-    if(0 != status)
+static int ReadCanonicalHeader(byte_t* codeLengths, bit_file_t* bfp)
+{
+    int nibbles = 0;
+    int c = 0;
+    while(c < NUM_CHARS)
     {
-        fprintf(stderr, "error: malformed file header.\n");
-        errno = EILSEQ;
+        int nibble = GetNibble(bfp);
+        nibbles++;
+        if(nibble == EOF)
+            break;
+
+        if(nibble == LONG_LEN_NIBBLE)
+        {
+            int extra = GetNibble(bfp);
+            nibbles++;
+            if(extra == EOF)
+                break;
+
+            codeLengths[c++] = (byte_t)(LONG_LEN_NIBBLE + extra);
+            continue;
+        }
+
+        if(nibble != 0)
+        {
+            codeLengths[c++] = (byte_t)nibble;
+            continue;
+        }
+
+        int run = GetNibble(bfp);
+        nibbles++;
+        if((run == EOF) || (c + run + 1 > NUM_CHARS))
+            break;
+
+        for(run++; run > 0; run--)
+            codeLengths[c++] = 0;
     }
-    return status;
+
+    if((c != NUM_CHARS) || (codeLengths[EOF_CHAR] == 0)
+        || ((nibbles % 2 != 0) && (GetNibble(bfp) == EOF)))
+    {
+        return -1;
+    }
+    return 0;
 }
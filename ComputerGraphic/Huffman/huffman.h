@@ -2,7 +2,49 @@
 #ifndef _HUFFMAN_H_
 #define _HUFFMAN_H_
 
-int HuffmanEncodeFile(FILE* inFile, FILE* outFile);
-int HuffmanDecodeFile(FILE* inFile, FILE* outFile);
+#include "dictionary.h"
+
+typedef struct huffman_options_t
+{
+    /* longest code the encoder may assign, 0 - no limit beyond the stream format */
+    unsigned int maxCodeLen;
+
+    /* interleaved sub-streams the codes are dealt to, 0 or 1 - a single stream */
+    unsigned int numStreams;
+
+    /* symbols of an independently coded block, 0 - the whole file is one block */
+    unsigned int blockSize;
+
+    /* threads coding blocks, 0 - one per hardware thread */
+    unsigned int numThreads;
+
+    /* non-zero - one pass adaptive codes, for inputs that can not be read twice */
+    int adaptive;
+
+    /* trained codes the stream refers to by id instead of carrying a header, nullptr - none */
+    const dictionary_t* dictionary;
+} huffman_options_t;
+
+void HuffmanDefaultOptions(huffman_options_t* options);
+
+int HuffmanEncodeFile(FILE* inFile, FILE* outFile, const huffman_options_t* options = nullptr);
+int HuffmanDecodeFile(FILE* inFile, FILE* outFile, const huffman_options_t* options = nullptr);
+
+/* code lengths for the counts DictionaryCount gathered over a corpus, then DictionaryFinish */
+int HuffmanTrainDictionary(const uint64_t* counts, dictionary_t* dictionary, const huffman_options_t* options = nullptr);
+
+/*
+* The same streams between buffers, without stdio or allocation apart from
+* length limiting a tree deeper than maxCodeLen. Blocks are coded one after
+* another on the calling thread, so numThreads is not used. The bytes
+* written go to dstSize, when they do not fit in capacity -1 is returned
+* with errno ENOSPC. HuffmanEncodeBound is enough capacity for any input of
+* size bytes coded with the same options.
+*/
+size_t HuffmanEncodeBound(const size_t size, const huffman_options_t* options = nullptr);
+int HuffmanEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const huffman_options_t* options = nullptr);
+int HuffmanDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const huffman_options_t* options = nullptr);
 
 #endif
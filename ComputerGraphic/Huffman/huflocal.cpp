@@ -4,120 +4,403 @@
 #include "huflocal.h"
 #include "huffman.h"
 
-huffman_node_t* GenerateTreeFromFile(FILE* inFile)
+int CountSymbols(FILE* inFile, count_t* counts)
 {
-    huffman_node_t* huffmanArray[NUM_CHARS];
     for(int i = 0; i < NUM_CHARS; i++)
-    {
-        if((huffmanArray[i] = AllocHuffmanNode(i)) == nullptr)
-        {
-            for(i--; i >= 0; i--)
-                delete huffmanArray[i];
-
-            return nullptr;
-        }
-    }
+        counts[i] = 0;
 
-    huffmanArray[EOF_CHAR]->count = 1;
-    huffmanArray[EOF_CHAR]->ignore = 0;
+    counts[EOF_CHAR] = 1;
     int c;
     while((c = fgetc(inFile)) != EOF)
     {
-        if(huffmanArray[c]->count < COUNT_T_MAX)
+        if(counts[c] < COUNT_T_MAX)
         {
-            huffmanArray[c]->count++;
-            huffmanArray[c]->ignore = 0;
+            counts[c]++;
         }
         else
         {
             fprintf(stderr,
                 "Input file contains too many 0x%02X to count.\n", c);
-            return nullptr;
+            return -1;
         }
     }
-    return BuildHuffmanTree(huffmanArray, NUM_CHARS);
+    return 0;
 }
 
-huffman_node_t* AllocHuffmanNode(int value)
+int CountBufferSymbols(const byte_t* data, size_t size, count_t* counts)
+{
+    /* no symbol can reach COUNT_T_MAX in a shorter buffer */
+    if(size >= COUNT_T_MAX)
+    {
+        fprintf(stderr, "Input file is too large to count.\n");
+        return -1;
+    }
+
+    for(int i = 0; i < NUM_CHARS; i++)
+        counts[i] = 0;
+
+    counts[EOF_CHAR] = 1;
+    for(size_t i = 0; i < size; i++)
+        counts[data[i]]++;
+    return 0;
+}
+
+/*
+* Merge order is the same as picking the two smallest nodes by count, then
+* level, then slot with a linear scan: a composite node takes the slot of its
+* left child, so the heap orders on that triple.
+*/
+typedef struct heap_item_t
+{
+    count_t count;
+    int level;
+    int slot;
+    int node;
+} heap_item_t;
+
+static bool HeapItemLess(const heap_item_t* a, const heap_item_t* b)
 {
-    huffman_node_t* ht = new huffman_node_t();
-    ht->value = value;
-    ht->ignore = 1;
-    ht->count = 0;
-    ht->level = 0;
-    ht->left = nullptr;
-    ht->right = nullptr;
-    ht->parent = nullptr;
-
-    return ht;
+    if(a->count != b->count)
+        return a->count < b->count;
+    if(a->level != b->level)
+        return a->level < b->level;
+    return a->slot < b->slot;
 }
 
-static huffman_node_t* AllocHuffmanCompositeNode(huffman_node_t *left, huffman_node_t *right)
+static void HeapPush(heap_item_t* heap, int* size, heap_item_t item)
 {
-    huffman_node_t* ht = new huffman_node_t();
-    ht->value = COMPOSITE_NODE;
-    ht->ignore = 0;
-    ht->count = left->count + right->count;
-    ht->level = max(left->level, right->level) + 1;
-    ht->left = left;
-    ht->left->parent = ht;
-    ht->right = right;
-    ht->right->parent = ht;
-    ht->parent = nullptr;
-
-    return ht;
+    int i = (*size)++;
+    while(i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if(!HeapItemLess(&item, &heap[parent]))
+            break;
+
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
 }
 
-void FreeHuffmanTree(huffman_node_t* ht)
+static heap_item_t HeapPop(heap_item_t* heap, int* size)
 {
-    if(ht->left != nullptr)
-        FreeHuffmanTree(ht->left);
+    heap_item_t top = heap[0];
+    heap_item_t last = heap[--(*size)];
+    int i = 0;
+    while(true)
+    {
+        int child = 2 * i + 1;
+        if(child >= *size)
+            break;
 
-    if(ht->right != nullptr)
-        FreeHuffmanTree(ht->right);
+        if((child + 1 < *size) && HeapItemLess(&heap[child + 1], &heap[child]))
+            child++;
 
-    delete ht;
+        if(!HeapItemLess(&heap[child], &last))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
 }
 
-static int FindMinimumCount(huffman_node_t** ht, int elements)
+int BuildHuffmanTree(huffman_tree_t* tree, const count_t* counts)
 {
-    int currentIndex = NONE;
-    unsigned int currentCount = UINT_MAX;
-    int currentLevel = INT_MAX;
-    for(int i = 0; i < elements; i++)
-    {
-        if((ht[i] != nullptr) && (!ht[i]->ignore) &&
-            (ht[i]->count < currentCount ||
-            (ht[i]->count == currentCount && ht[i]->level < currentLevel)))
+    heap_item_t heap[NUM_CHARS];
+    int heapSize = 0;
+    for(int i = 0; i < NUM_CHARS; i++)
+    {
+        huffman_node_t* leaf = &tree->nodes[i];
+        leaf->value = i;
+        leaf->count = counts[i];
+        leaf->level = 0;
+        leaf->left = NONE;
+        leaf->right = NONE;
+
+        if(counts[i] != 0)
         {
-            currentIndex = i;
-            currentCount = ht[i]->count;
-            currentLevel = ht[i]->level;
+            heap_item_t item = { counts[i], 0, i, i };
+            HeapPush(heap, &heapSize, item);
         }
     }
-    return currentIndex;
+
+    tree->numNodes = NUM_CHARS;
+    tree->root = NONE;
+    while(heapSize > 1)
+    {
+        heap_item_t min1 = HeapPop(heap, &heapSize);
+        heap_item_t min2 = HeapPop(heap, &heapSize);
+
+        huffman_node_t* ht = &tree->nodes[tree->numNodes];
+        ht->value = COMPOSITE_NODE;
+        ht->count = min1.count + min2.count;
+        ht->level = max(min1.level, min2.level) + 1;
+        ht->left = (short)min1.node;
+        ht->right = (short)min2.node;
+
+        heap_item_t item = { ht->count, ht->level, min1.slot, tree->numNodes };
+        HeapPush(heap, &heapSize, item);
+        tree->numNodes++;
+    }
+
+    if(heapSize == 1)
+        tree->root = heap[0].node;
+    return tree->root;
 }
 
-huffman_node_t* BuildHuffmanTree(huffman_node_t** ht, int elements)
+int MakeCodeLengths(const huffman_tree_t* tree, byte_t* codeLengths)
 {
-    int min1;
-    int min2;
-    while(true)
+    for(int i = 0; i < NUM_CHARS; i++)
+        codeLengths[i] = 0;
+
+    /* a tree of one leaf still needs a one bit code */
+    if(tree->root < NUM_CHARS)
     {
-        min1 = FindMinimumCount(ht, elements);
-        if(min1 == NONE)
-            break;
-        ht[min1]->ignore = 1;
+        codeLengths[tree->root] = 1;
+        return 1;
+    }
 
-        min2 = FindMinimumCount(ht, elements);
-        if(min2 == NONE)
-            break;
-        ht[min2]->ignore = 1;
+    /* children are always merged before their parent, so walk the arena backwards */
+    byte_t depth[2 * NUM_CHARS - 1];
+    depth[tree->root] = 0;
+    int maxDepth = 0;
+    for(int i = tree->numNodes - 1; i >= NUM_CHARS; i--)
+    {
+        const huffman_node_t* ht = &tree->nodes[i];
+        depth[ht->left] = depth[i] + 1;
+        depth[ht->right] = depth[i] + 1;
+    }
+
+    for(int i = 0; i < NUM_CHARS; i++)
+    {
+        if(tree->nodes[i].count != 0)
+        {
+            codeLengths[i] = depth[i];
+            maxDepth = max(maxDepth, (int)depth[i]);
+        }
+    }
+    return maxDepth;
+}
 
-        if((ht[min1] = AllocHuffmanCompositeNode(ht[min1], ht[min2])) == nullptr)
-            return nullptr;
+/*
+* Package-merge: the optimal code lengths not longer than maxCodeLen. Every
+* level merges the leaves with pairs (packages) of the level below, and the
+* 2n - 2 lightest items of the top level decide the lengths. The items taken
+* from a level are always a prefix of it, so walking back down only needs
+* the number of leaves and packages in each prefix, and the leaves in a
+* prefix are the lightest symbols.
+*/
+void MakeLimitedCodeLengths(const count_t* counts, int maxCodeLen, byte_t* codeLengths)
+{
+    int symbols[NUM_CHARS];
+    int n = 0;
+    for(int i = 0; i < NUM_CHARS; i++)
+    {
+        codeLengths[i] = 0;
+        if(counts[i] != 0)
+            symbols[n++] = i;
+    }
 
-        ht[min2] = nullptr;
+    if(n == 1)
+    {
+        codeLengths[symbols[0]] = 1;
+        return;
+    }
+
+    /* lightest first, ties broken by symbol so the result does not depend on the sort */
+    for(int i = 1; i < n; i++)
+    {
+        int symbol = symbols[i];
+        int j = i;
+        while((j > 0) && ((counts[symbols[j - 1]] > counts[symbol]) ||
+            ((counts[symbols[j - 1]] == counts[symbol]) && (symbols[j - 1] > symbol))))
+        {
+            symbols[j] = symbols[j - 1];
+            j--;
+        }
+        symbols[j] = symbol;
+    }
+
+    const int maxItems = 2 * NUM_CHARS;
+    uint64_t* weights = new uint64_t[maxCodeLen * maxItems];
+    int* leaves = new int[maxCodeLen * maxItems];   /* leaves in the first i items of a level */
+    int* sizes = new int[maxCodeLen];
+
+    for(int i = 0; i < n; i++)
+    {
+        weights[i] = counts[symbols[i]];
+        leaves[i] = i + 1;
+    }
+    sizes[0] = n;
+
+    for(int level = 1; level < maxCodeLen; level++)
+    {
+        const uint64_t* below = &weights[(level - 1) * maxItems];
+        uint64_t* merged = &weights[level * maxItems];
+        int* mergedLeaves = &leaves[level * maxItems];
+        int packages = sizes[level - 1] / 2;
+        int leaf = 0;
+        int package = 0;
+        int size = 0;
+        while((leaf < n) || (package < packages))
+        {
+            uint64_t packageWeight = (package < packages) ?
+                below[2 * package] + below[2 * package + 1] : 0;
+
+            if((package == packages) || ((leaf < n) && (counts[symbols[leaf]] <= packageWeight)))
+            {
+                merged[size] = counts[symbols[leaf]];
+                leaf++;
+            }
+            else
+            {
+                merged[size] = packageWeight;
+                package++;
+            }
+            mergedLeaves[size] = leaf;
+            size++;
+        }
+        sizes[level] = size;
+    }
+
+    int taken = 2 * n - 2;
+    for(int level = maxCodeLen - 1; (level >= 0) && (taken > 0); level--)
+    {
+        int leafCount = leaves[level * maxItems + taken - 1];
+        for(int i = 0; i < leafCount; i++)
+            codeLengths[symbols[i]]++;
+
+        taken = 2 * (taken - leafCount);
+    }
+
+    delete[] sizes;
+    delete[] leaves;
+    delete[] weights;
+}
+
+void MakeCanonicalCodes(const byte_t* codeLengths, uint32_t* codes)
+{
+    unsigned int lengthCount[MAX_CODE_LEN + 1];
+    for(int len = 0; len <= MAX_CODE_LEN; len++)
+        lengthCount[len] = 0;
+
+    for(int i = 0; i < NUM_CHARS; i++)
+        lengthCount[codeLengths[i]]++;
+    lengthCount[0] = 0;
+
+    uint32_t nextCode[MAX_CODE_LEN + 1];
+    uint32_t code = 0;
+    for(int len = 1; len <= MAX_CODE_LEN; len++)
+    {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    for(int i = 0; i < NUM_CHARS; i++)
+    {
+        if(codeLengths[i] != 0)
+            codes[i] = nextCode[codeLengths[i]]++;
+        else
+            codes[i] = 0;
+    }
+}
+
+void InitAdaptiveTree(adaptive_tree_t* tree)
+{
+    for(int i = 0; i < NUM_CHARS; i++)
+        tree->leaves[i] = NONE;
+
+    tree->nyt = ADAPTIVE_ROOT;
+    adaptive_node_t* nyt = &tree->nodes[ADAPTIVE_ROOT];
+    nyt->weight = 0;
+    nyt->parent = NONE;
+    nyt->left = NONE;
+    nyt->right = NONE;
+    nyt->symbol = NONE;
+}
+
+/* moves the subtrees in slots a and b, each slot keeps its parent */
+static void SwapAdaptiveNodes(adaptive_tree_t* tree, int a, int b)
+{
+    adaptive_node_t* nodes = tree->nodes;
+    adaptive_node_t tmp = nodes[a];
+    short parentA = nodes[a].parent;
+    short parentB = nodes[b].parent;
+    nodes[a] = nodes[b];
+    nodes[a].parent = parentA;
+    nodes[b] = tmp;
+    nodes[b].parent = parentB;
+
+    int slots[2] = { a, b };
+    for(int i = 0; i < 2; i++)
+    {
+        adaptive_node_t* node = &nodes[slots[i]];
+        if(node->left != NONE)
+        {
+            nodes[node->left].parent = (short)slots[i];
+            nodes[node->right].parent = (short)slots[i];
+        }
+        else if(node->symbol != NONE)
+        {
+            tree->leaves[node->symbol] = (short)slots[i];
+        }
+    }
+}
+
+/*
+* Counts one more symbol. A new symbol splits the NYT leaf into a new NYT
+* and the symbol's leaf. Walking up from the leaf, every node is first
+* swapped with the highest numbered node of the same weight, unless that is
+* its parent, so the increment keeps weights in slot order.
+*/
+void UpdateAdaptiveTree(adaptive_tree_t* tree, int symbol)
+{
+    adaptive_node_t* nodes = tree->nodes;
+    if(nodes[ADAPTIVE_ROOT].weight >= ADAPTIVE_MAX_WEIGHT)
+        InitAdaptiveTree(tree);
+
+    int node = tree->leaves[symbol];
+    if(node == NONE)
+    {
+        int nyt = tree->nyt;
+        adaptive_node_t* leaf = &nodes[nyt - 1];
+        leaf->weight = 0;
+        leaf->parent = (short)nyt;
+        leaf->left = NONE;
+        leaf->right = NONE;
+        leaf->symbol = (short)symbol;
+
+        adaptive_node_t* newNyt = &nodes[nyt - 2];
+        newNyt->weight = 0;
+        newNyt->parent = (short)nyt;
+        newNyt->left = NONE;
+        newNyt->right = NONE;
+        newNyt->symbol = NONE;
+
+        nodes[nyt].left = (short)(nyt - 2);
+        nodes[nyt].right = (short)(nyt - 1);
+        tree->leaves[symbol] = (short)(nyt - 1);
+        tree->nyt = (short)(nyt - 2);
+        node = nyt - 1;
+    }
+
+    while(true)
+    {
+        int leader = node;
+        while((leader < ADAPTIVE_ROOT) && (nodes[leader + 1].weight == nodes[node].weight))
+            leader++;
+
+        if((leader != node) && (leader != nodes[node].parent))
+        {
+            SwapAdaptiveNodes(tree, node, leader);
+            node = leader;
+        }
+
+        nodes[node].weight++;
+        if(node == ADAPTIVE_ROOT)
+            break;
+        node = nodes[node].parent;
     }
-    return ht[min1];
 }
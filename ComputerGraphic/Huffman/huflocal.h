@@ -2,6 +2,7 @@
 #define _HUFFMAN_LOCAL_H
 
 #include <limits.h>
+#include <stdint.h>
 
 #if (UCHAR_MAX != 0xFF)
 #error This program expects unsigned char to be 1 byte
@@ -18,11 +19,10 @@ typedef struct huffman_node_t
 {
     int value;
     count_t count;
-
-    char ignore;
     int level;
 
-    struct huffman_node_t *left, *right, *parent;
+    /* indices into huffman_tree_t::nodes, NONE for leaves */
+    short left, right;
 } huffman_node_t;
 
 #define NONE    -1
@@ -33,11 +33,64 @@ typedef struct huffman_node_t
 #define NUM_CHARS   (UCHAR_MAX + 2)
 #define EOF_CHAR    (NUM_CHARS - 1)
 
+/* longest code a canonical header can describe */
+#define MAX_CODE_LEN    30
+
+/* shortest length limit that still has room for all NUM_CHARS codes */
+#define MIN_CODE_LEN_LIMIT  9
+
 #define max(a, b) ((a)>(b)?(a):(b))
 
-huffman_node_t* GenerateTreeFromFile(FILE* inFile);
-huffman_node_t* BuildHuffmanTree(huffman_node_t** ht, int elements);
-huffman_node_t* AllocHuffmanNode(int value);
-void FreeHuffmanTree(huffman_node_t* ht);
+/*
+* Node arena of one tree: leaves sit at their symbol, composite nodes follow
+* in the order they were merged. Building a tree reuses the whole arena.
+*/
+typedef struct huffman_tree_t
+{
+    huffman_node_t nodes[2 * NUM_CHARS - 1];
+    int numNodes;
+    int root;
+} huffman_tree_t;
+
+/*
+* FGK adaptive tree. A node's number is its slot: weights never decrease
+* with the slot and siblings sit in neighbouring slots. The root takes the
+* last slot and the NYT (not yet transmitted) leaf the lowest one in use.
+*/
+#define ADAPTIVE_NODES  (2 * (NUM_CHARS + 1) - 1)
+#define ADAPTIVE_ROOT   (ADAPTIVE_NODES - 1)
+
+/* root weight at which both sides start over from an empty tree */
+#define ADAPTIVE_MAX_WEIGHT     (1u << 30)
+
+typedef struct adaptive_node_t
+{
+    count_t weight;
+    short parent;
+
+    /* children of an internal node, NONE for leaves */
+    short left, right;
+
+    /* symbol of a leaf, NONE for internal nodes and the NYT leaf */
+    short symbol;
+} adaptive_node_t;
+
+typedef struct adaptive_tree_t
+{
+    adaptive_node_t nodes[ADAPTIVE_NODES];
+    short leaves[NUM_CHARS];
+    short nyt;
+} adaptive_tree_t;
+
+void InitAdaptiveTree(adaptive_tree_t* tree);
+void UpdateAdaptiveTree(adaptive_tree_t* tree, int symbol);
+
+int CountSymbols(FILE* inFile, count_t* counts);
+int CountBufferSymbols(const byte_t* data, size_t size, count_t* counts);
+int BuildHuffmanTree(huffman_tree_t* tree, const count_t* counts);
+
+int MakeCodeLengths(const huffman_tree_t* tree, byte_t* codeLengths);
+void MakeLimitedCodeLengths(const count_t* counts, int maxCodeLen, byte_t* codeLengths);
+void MakeCanonicalCodes(const byte_t* codeLengths, uint32_t* codes);
 
 #endif
@@ -6,15 +6,91 @@
 #include "huffman.h"
 #include <experimental/filesystem>
 
+/* extensions of coded files and dictionaries, which say nothing about the inputs */
+static bool IsCodedFile(const std::experimental::filesystem::path& filePath)
+{
+    std::string ext = filePath.extension().string();
+    return ext.compare(".Huffman") == 0 || ext.compare(".Rlc") == 0 || ext.compare(".Arc") == 0
+        || ext.compare(".Ans") == 0 || ext.compare(".dic") == 0;
+}
+
+/* a dictionary from every file of the corpus directory */
+static void TrainDictionary(const char* corpus, const char* dictionaryPath, const huffman_options_t* options)
+{
+    uint64_t counts[DICTIONARY_SYMBOLS] = { 0 };
+    for(auto& entry : std::experimental::filesystem::directory_iterator(corpus))
+    {
+        if(!std::experimental::filesystem::is_regular_file(entry.path()) || IsCodedFile(entry.path()))
+            continue;
+
+        FILE* inFile = fopen(entry.path().string().c_str(), "rb");
+        if(inFile == nullptr)
+            continue;
+        DictionaryCount(inFile, counts);
+        fclose(inFile);
+    }
+
+    dictionary_t dictionary;
+    if(HuffmanTrainDictionary(counts, &dictionary, options) != 0)
+        return;
+
+    FILE* outFile = fopen(dictionaryPath, "wb");
+    if(outFile == nullptr)
+        return;
+    DictionaryWrite(outFile, &dictionary);
+    fclose(outFile);
+}
+
 void main(int argc, const char* argv[])
 {
-    if(argc == 0)
+    if(argc < 2)
+        return;
+
+    huffman_options_t options;
+    HuffmanDefaultOptions(&options);
+    const char* trainPath = nullptr;
+    const char* dictionaryPath = nullptr;
+    for(int i = 1; i < argc - 1; i++)
+    {
+        if((strcmp(argv[i], "-l") == 0) && (i + 1 < argc - 1))
+            options.maxCodeLen = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-s") == 0) && (i + 1 < argc - 1))
+            options.numStreams = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-b") == 0) && (i + 1 < argc - 1))
+            options.blockSize = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-t") == 0) && (i + 1 < argc - 1))
+            options.numThreads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-a") == 0)
+            options.adaptive = 1;
+        else if((strcmp(argv[i], "-train") == 0) && (i + 1 < argc - 1))
+            trainPath = argv[++i];
+        else if((strcmp(argv[i], "-k") == 0) && (i + 1 < argc - 1))
+            dictionaryPath = argv[++i];
+    }
+
+    if(trainPath != nullptr)
+    {
+        TrainDictionary(argv[argc - 1], trainPath, &options);
         return;
+    }
+
+    dictionary_t dictionary;
+    if(dictionaryPath != nullptr)
+    {
+        FILE* dictionaryFile = fopen(dictionaryPath, "rb");
+        if(dictionaryFile == nullptr)
+            return;
+        int status = DictionaryRead(dictionaryFile, &dictionary);
+        fclose(dictionaryFile);
+        if(status != 0)
+            return;
+        options.dictionary = &dictionary;
+    }
 
-    std::experimental::filesystem::path filePath = argv[1];
+    std::experimental::filesystem::path filePath = argv[argc - 1];
     std::string ext = filePath.extension().string();
 
-    if(ext.compare(".Rlc") == 0 || ext.compare(".Arc") == 0)
+    if(ext.compare(".Rlc") == 0 || ext.compare(".Arc") == 0 || ext.compare(".Ans") == 0 || ext.compare(".dic") == 0)
         return;
 
     bool encode = ext.compare(".Huffman") != 0;
@@ -38,9 +114,9 @@ void main(int argc, const char* argv[])
     }
 
     if(encode)
-        HuffmanEncodeFile(inFile, outFile);
+        HuffmanEncodeFile(inFile, outFile, &options);
     else
-        HuffmanDecodeFile(inFile, outFile);
+        HuffmanDecodeFile(inFile, outFile, &options);
 
     fclose(inFile);
     fclose(outFile);
@@ -1,109 +1,817 @@
 #include "pch.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <limits.h>
 #include <errno.h>
+#include "rle.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define RLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define MIN_RUN     3                   /* minimum run length to encode */
 #define MAX_RUN     (128 + MIN_RUN - 1) /* maximum run length to encode */
 #define MAX_COPY    128                 /* maximum characters to copy */
 
-/* maximum that can be read before copy block is written */
-#define MAX_READ    (MAX_COPY + MIN_RUN - 1)
+/*
+* Those are the defaults, the options can change them. A classic count
+* byte has room for 128 run lengths from the minimum on and 128 copy
+* lengths.
+*/
+#define CLASSIC_MAX_LENGTHS 128
+
+/*
+* The varint format has no such limits on a block but VARINT_MAX_BLOCK.
+* Its blocks start with a control, the length less the least a block can
+* have shifted left by one and a 1 for runs, written 7 bits a byte from the
+* low bits with the top bit set when a byte follows. Every control fits in
+* two bytes, one byte holds lengths up to VARINT_SHORT_LENGTHS over the least.
+*/
+#define VARINT_MAX_BLOCK        8192
+#define VARINT_SHORT_LENGTHS    64
+
+/* the most a coded block can take, a varint copy with its control */
+#define MAX_BLOCK_BYTES     (VARINT_MAX_BLOCK + 2)
+
+/* input read from a FILE at a time, and what has to follow a position before its block is chosen */
+#define IO_BLOCK_SIZE   (1 << 14)
+#define MAX_LOOKAHEAD   (2 * VARINT_MAX_BLOCK + RLE_MAX_MIN_RUN - 1)
+
+/* the optimal parse finds the smallest blocks for a window of input at a time, so a FILE is held that far ahead too */
+#define PARSE_WINDOW    IO_BLOCK_SIZE
+
+/*
+* A stream in any format but the classic one starts with two runs of
+* MIN_RUN 'R', which the classic coder would have made a single run, and a
+* format byte. VARINT_FLAG in it is set for varint blocks, PARAMS_FLAG for
+* block settings other than the defaults, which follow as the minimum run
+* in a byte and the maximum run and copy in 16 bits each. That is all for
+* the classic format. The rows format then keeps the width, the number of
+* rows, the rows between index entries and the length of the PGM header,
+* 32 bits each but the interval of 16, all big endian. The PGM header
+* follows as it was, then for every interval rows where their first row
+* starts in the coded data, then the rows and what follows the image coded
+* like the classic format, every row on its own.
+*/
+#define RLE_SIGNATURE_SIZE  4
+#define RLE_HEADER_SIZE     (RLE_SIGNATURE_SIZE + 1)
+#define PARAMS_SIZE         5
+#define ROWS_HEADER_SIZE    14
+#define MAX_HEADER_SIZE     (RLE_HEADER_SIZE + PARAMS_SIZE + ROWS_HEADER_SIZE)
+#define VARINT_FLAG         0x80
+#define PARAMS_FLAG         0x40
+#define MAX_IMAGE_SIZE      (1u << 20)
+
+static const unsigned char RleSignature[RLE_SIGNATURE_SIZE] = { 0xFF, 'R', 0xFF, 'R' };
 
-int RleEncodeFile(FILE* inFile, FILE* outFile)
+typedef struct rle_header_t
 {
-    if((nullptr == inFile) || (nullptr == outFile))
+    RLE_FORMATS format;
+    bool varint;
+    unsigned int minRun;
+    unsigned int maxRun;
+    unsigned int maxCopy;
+    unsigned int width;
+    unsigned int height;
+    unsigned int interval;
+    size_t headerLen;
+    size_t groups;      /* entries in the index */
+} rle_header_t;
+
+/* how blocks are chosen and written */
+typedef struct rle_coder_t
+{
+    size_t minRun;
+    size_t maxRun;
+    size_t maxCopy;
+    bool varint;
+    bool optimal;
+} rle_coder_t;
+
+/*
+* One side of a coder: a FILE, or when fp is nullptr size bytes of a caller's
+* buffer. Writes past the end of a buffer are dropped and set error.
+*/
+typedef struct rle_stream_t
+{
+    FILE* fp;
+    unsigned char* buffer;
+    size_t size;
+    size_t pos;
+    int error;
+} rle_stream_t;
+
+typedef enum
+{
+    RLE_OK = 0,
+    RLE_SHORT_RUN,
+    RLE_SHORT_COPY,
+    RLE_NO_ROOM,
+    RLE_SHORT_ROWS,
+    RLE_BAD_LENGTH
+} RLE_STATUS;
+
+/* decodes blocks of one format, see RleDecodeSpan */
+typedef RLE_STATUS (*rle_span_decoder_t)(const unsigned char* src, const size_t size, unsigned char* dst,
+    const size_t capacity, const size_t minRun, size_t* srcUsed, size_t* dstUsed);
+
+static void InitFileStream(rle_stream_t* stream, FILE* fp)
+{
+    stream->fp = fp;
+    stream->buffer = nullptr;
+    stream->size = 0;
+    stream->pos = 0;
+    stream->error = 0;
+}
+
+static void InitBufferStream(rle_stream_t* stream, unsigned char* buffer, const size_t size)
+{
+    stream->fp = nullptr;
+    stream->buffer = buffer;
+    stream->size = size;
+    stream->pos = 0;
+    stream->error = 0;
+}
+
+static inline void RlePutChar(const int c, rle_stream_t* stream)
+{
+    if(stream->fp != nullptr)
     {
-        errno = ENOENT;
-        return -1;
+        fputc(c, stream->fp);
+    }
+    else if(stream->pos < stream->size)
+    {
+        stream->buffer[stream->pos++] = (unsigned char)c;
     }
+    else
+    {
+        stream->error = 1;
+    }
+}
 
-    int currChar = fgetc(inFile);
-    unsigned char count = 0;
-    unsigned char charBuf[MAX_READ];
-    while(currChar != EOF)
+static void RleWrite(const unsigned char* bytes, const size_t count, rle_stream_t* stream)
+{
+    if(stream->fp != nullptr)
+    {
+        fwrite(bytes, sizeof(unsigned char), count, stream->fp);
+    }
+    else if(count <= stream->size - stream->pos)
+    {
+        memcpy(stream->buffer + stream->pos, bytes, count);
+        stream->pos += count;
+    }
+    else
+    {
+        stream->error = 1;
+    }
+}
+
+#ifdef RLE_SSE2
+static inline int FirstSetBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*
+* Where the first MIN_RUN equal bytes start from pos on, end when no run
+* starts before end. Bytes up to end + MIN_RUN - 1 are read, 16 starts are
+* tried at a time.
+*/
+static size_t FindTriple(const unsigned char* data, size_t pos, size_t end)
+{
+#ifdef RLE_SSE2
+    for(; pos + 16 <= end; pos += 16)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i second = _mm_loadu_si128((const __m128i*)(data + pos + 1));
+        __m128i third = _mm_loadu_si128((const __m128i*)(data + pos + 2));
+        __m128i equal = _mm_and_si128(_mm_cmpeq_epi8(first, second), _mm_cmpeq_epi8(second, third));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(equal);
+        if(mask != 0)
+            return pos + FirstSetBit(mask);
+    }
+#endif
+
+    for(; pos < end; pos++)
+    {
+        if((data[pos] == data[pos + 1]) && (data[pos] == data[pos + 2]))
+            return pos;
+    }
+    return end;
+}
+
+/* the same for two equal bytes, bytes up to end are read */
+static size_t FindPair(const unsigned char* data, size_t pos, size_t end)
+{
+#ifdef RLE_SSE2
+    for(; pos + 16 <= end; pos += 16)
     {
-        charBuf[count] = (unsigned char)currChar;
-        count++;
-        if(count >= MIN_RUN)
+        __m128i first = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i second = _mm_loadu_si128((const __m128i*)(data + pos + 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(first, second));
+        if(mask != 0)
+            return pos + FirstSetBit(mask);
+    }
+#endif
+
+    for(; pos < end; pos++)
+    {
+        if(data[pos] == data[pos + 1])
+            return pos;
+    }
+    return end;
+}
+
+/* bytes equal to run[0] from run on, up to max */
+static size_t RunLength(const unsigned char* run, size_t max)
+{
+    size_t len = 1;
+#ifdef RLE_SSE2
+    __m128i value = _mm_set1_epi8((char)run[0]);
+    for(; len + 16 <= max; len += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(run + len));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, value)) ^ 0xFFFF;
+        if(mask != 0)
+            return len + FirstSetBit(mask);
+    }
+#endif
+
+    while((len < max) && (run[len] == run[0]))
+        len++;
+    return len;
+}
+
+/* where the first minRun equal bytes start from pos on, end when no run starts before end */
+static size_t FindRun(const unsigned char* data, size_t pos, const size_t end, const size_t minRun)
+{
+    if(minRun < MIN_RUN)
+        return FindPair(data, pos, end);
+
+    while((pos = FindTriple(data, pos, end)) != end)
+    {
+        if((minRun == MIN_RUN) || (RunLength(data + pos, minRun) == minRun))
+            break;
+        pos++;
+    }
+    return pos;
+}
+
+static inline void RleWriteControl(const size_t control, rle_stream_t* outFile)
+{
+    if(control < 0x80)
+    {
+        RlePutChar((int)control, outFile);
+    }
+    else
+    {
+        RlePutChar((int)(0x80 | (control & 0x7F)), outFile);
+        RlePutChar((int)(control >> 7), outFile);
+    }
+}
+
+static void RleWriteCopy(const unsigned char* bytes, const size_t count, const rle_coder_t* coder,
+    rle_stream_t* outFile)
+{
+    if(coder->varint)
+        RleWriteControl((count - 1) << 1, outFile);
+    else
+        RlePutChar((int)count - 1, outFile);
+    RleWrite(bytes, count, outFile);
+}
+
+static void RleWriteRun(const int c, const size_t len, const rle_coder_t* coder, rle_stream_t* outFile)
+{
+    if(coder->varint)
+        RleWriteControl(((len - coder->minRun) << 1) | 1, outFile);
+    else
+        RlePutChar((char)((int)(coder->minRun - 1) - (int)len), outFile);
+    RlePutChar(c, outFile);
+}
+
+/* count bytes as copies of at most maxCopy */
+static void RleWriteCopies(const unsigned char* bytes, size_t count, const rle_coder_t* coder,
+    rle_stream_t* outFile)
+{
+    while(count != 0)
+    {
+        size_t len = (count < coder->maxCopy) ? count : coder->maxCopy;
+        RleWriteCopy(bytes, len, coder, outFile);
+        bytes += len;
+        count -= len;
+    }
+}
+
+/* what has to follow a position before the greedy coder can take a step from it */
+static inline size_t GreedyLookahead(const rle_coder_t* coder)
+{
+    return coder->maxCopy + coder->minRun - 1 + coder->maxRun;
+}
+
+/*
+* One step of a greedy coder taking a byte at a time from pos: a run from
+* the first minRun equal bytes, up to maxRun, with the bytes before it
+* copied, or a copy of maxCopy once maxCopy + minRun - 1 bytes went by
+* without a run. Fewer bytes left than that are all copied. Returns where
+* the step ends, with the bytes copied in copyLen and the run in runLen.
+*/
+static size_t GreedyStep(const unsigned char* data, const size_t pos, const size_t size, const rle_coder_t* coder,
+    size_t* copyLen, size_t* runLen)
+{
+    const size_t minRun = coder->minRun;
+    const size_t maxCopy = coder->maxCopy;
+
+    /* a run has to start within maxCopy bytes and have minRun bytes before the end */
+    size_t end = (size - pos >= minRun) ? size - (minRun - 1) : pos;
+    if(end > pos + maxCopy)
+        end = pos + maxCopy;
+
+    size_t run = FindRun(data, pos, end, minRun);
+    if(run != end)
+    {
+        *copyLen = run - pos;
+        *runLen = RunLength(data + run, (size - run < coder->maxRun) ? size - run : coder->maxRun);
+        return run + *runLen;
+    }
+
+    *copyLen = (size - pos >= maxCopy + minRun - 1) ? maxCopy : size - pos;
+    *runLen = 0;
+    return pos + *copyLen;
+}
+
+/*
+* Block lengths from lo to hi that code with the same bytes besides what
+* is copied, and the ends of such blocks from a position as it moves down.
+* The ends kept have rising costs from the last one, which has the least.
+*/
+typedef struct block_window_t
+{
+    size_t lo;
+    size_t hi;
+    unsigned int bytes;
+    bool run;
+    unsigned short* ends;
+    size_t capacity;
+    size_t first;
+    size_t count;
+} block_window_t;
+
+/* the ends all windows keep, short and long copies and runs of no more than VARINT_MAX_BLOCK */
+#define PARSE_ENDS  (2 * VARINT_MAX_BLOCK + 2 * CLASSIC_MAX_LENGTHS)
+
+/* what a block to end adds besides its bytes, copies pay for every byte to end */
+static inline unsigned int EndCost(const block_window_t* window, const unsigned short* cost, const size_t end)
+{
+    return window->run ? cost[end] : cost[end] + (unsigned int)end;
+}
+
+static void AddWindow(block_window_t* windows, int* numWindows, const size_t lo, const size_t hi,
+    const unsigned int bytes, const bool run)
+{
+    if(lo > hi)
+        return;
+
+    block_window_t* window = &windows[(*numWindows)++];
+    window->lo = lo;
+    window->hi = hi;
+    window->bytes = bytes;
+    window->run = run;
+    window->capacity = hi - lo + 1;
+}
+
+/*
+* Codes data in windows of up to PARSE_WINDOW bytes with the fewest bytes
+* for each, stopping where less than a window and the lookahead of its
+* last greedy step are left unless last. A window ends where a step of the
+* greedy coder does, so its blocks are one way to code the window and the
+* next one starts where the greedy coder would start too: nothing comes
+* out larger than greedy blocks. The fewest bytes from every
+* position to the end of the window go from the end down: the least over
+* the blocks that can start there of the block and what follows it. For
+* every kind of block the ends in reach slide down with the position, so
+* the least of them is kept in a window. A window costs at most two bytes
+* a byte, so costs and positions fit 16 bits.
+*/
+static size_t RleEncodeOptimal(const unsigned char* data, const size_t size, const bool last,
+    const rle_coder_t* coder, rle_stream_t* outFile)
+{
+    unsigned short cost[PARSE_WINDOW + 1];
+    short choice[PARSE_WINDOW];
+    unsigned short ends[PARSE_ENDS];
+
+    block_window_t windows[4];
+    int numWindows = 0;
+    size_t shortCopy = coder->varint ? VARINT_SHORT_LENGTHS : coder->maxCopy;
+    size_t shortRun = coder->varint ? coder->minRun + VARINT_SHORT_LENGTHS - 1 : coder->maxRun;
+    AddWindow(windows, &numWindows, 1, (coder->maxCopy < shortCopy) ? coder->maxCopy : shortCopy, 1, false);
+    AddWindow(windows, &numWindows, shortCopy + 1, coder->maxCopy, 2, false);
+    AddWindow(windows, &numWindows, coder->minRun, (coder->maxRun < shortRun) ? coder->maxRun : shortRun, 2, true);
+    AddWindow(windows, &numWindows, shortRun + 1, coder->maxRun, 3, true);
+
+    unsigned short* end = ends;
+    for(int w = 0; w < numWindows; w++)
+    {
+        windows[w].ends = end;
+        end += windows[w].capacity;
+    }
+
+    const size_t lookahead = GreedyLookahead(coder);
+    size_t pos = 0;
+    while(pos < size)
+    {
+        if(!last && (size - pos < PARSE_WINDOW + lookahead))
+            break;
+
+        /* greedy steps up to PARSE_WINDOW, a step is never longer */
+        size_t n = 0;
+        while(pos + n < size)
+        {
+            size_t copyLen, runLen;
+            size_t next = GreedyStep(data, pos + n, size, coder, &copyLen, &runLen);
+            if(next - pos > PARSE_WINDOW)
+                break;
+            n = next - pos;
+        }
+
+        const unsigned char* bytes = data + pos;
+        for(int w = 0; w < numWindows; w++)
+            windows[w].first = windows[w].count = 0;
+
+        size_t runEnd = n;
+        cost[n] = 0;
+        for(size_t i = n; i-- > 0;)
         {
-            int i;
-            for(i = 2; i <= MIN_RUN; i++)
+            /* runs end where the equal bytes do */
+            if((i + 1 == n) || (bytes[i] != bytes[i + 1]))
             {
-                if(currChar != charBuf[count - i])
+                runEnd = i + 1;
+                for(int w = 0; w < numWindows; w++)
                 {
-                    i = 0;
-                    break;
+                    if(windows[w].run)
+                        windows[w].count = 0;
                 }
             }
 
-            if(i != 0)
+            unsigned int best = UINT_MAX;
+            for(int w = 0; w < numWindows; w++)
             {
-                int nextChar;
-                if(count > MIN_RUN)
+                block_window_t* bw = &windows[w];
+                size_t limit = bw->run ? runEnd : n;
+                size_t j = i + bw->lo;
+                while((bw->count != 0) && (bw->ends[(bw->first + bw->count - 1) % bw->capacity] > i + bw->hi))
+                    bw->count--;
+                if(j <= limit)
                 {
-                    fputc(count - MIN_RUN - 1, outFile);
-                    fwrite(charBuf, sizeof(unsigned char), count - MIN_RUN,
-                        outFile);
+                    unsigned int jCost = EndCost(bw, cost, j);
+                    while((bw->count != 0) && (EndCost(bw, cost, bw->ends[bw->first]) >= jCost))
+                    {
+                        bw->first = (bw->first + 1) % bw->capacity;
+                        bw->count--;
+                    }
+                    bw->first = (bw->first + bw->capacity - 1) % bw->capacity;
+                    bw->ends[bw->first] = (unsigned short)j;
+                    bw->count++;
                 }
+                if(bw->count == 0)
+                    continue;
 
-                count = MIN_RUN;
-                while((nextChar = fgetc(inFile)) == currChar)
+                size_t least = bw->ends[(bw->first + bw->count - 1) % bw->capacity];
+                unsigned int total = cost[least] + bw->bytes + (bw->run ? 0 : (unsigned int)(least - i));
+                if(total < best)
                 {
-                    count++;
-                    if(MAX_RUN == count)
-                        break;
-                }
-
-                fputc((char)((int)(MIN_RUN - 1) - (int)(count)), outFile);
-                fputc(currChar, outFile);
-
-                if((nextChar != EOF) && (count != MAX_RUN))
-                {
-                    charBuf[0] = nextChar;
-                    count = 1;
-                }
-                else
-                {
-                    count = 0;
+                    best = total;
+                    choice[i] = (short)(bw->run ? -(int)(least - i) : (int)(least - i));
                 }
             }
+            cost[i] = (unsigned short)best;
         }
 
-        if(MAX_READ == count)
+        for(size_t i = 0; i < n;)
         {
-            int i;
-            fputc(MAX_COPY - 1, outFile);
-            fwrite(charBuf, sizeof(unsigned char), MAX_COPY, outFile);
-            count = MAX_READ - MAX_COPY;
-
-            for(i = 0; i < count; i++)
-                charBuf[i] = charBuf[MAX_COPY + i];
+            if(choice[i] > 0)
+            {
+                RleWriteCopy(bytes + i, choice[i], coder, outFile);
+                i += choice[i];
+            }
+            else
+            {
+                RleWriteRun(bytes[i], -choice[i], coder, outFile);
+                i -= choice[i];
+            }
         }
-        currChar = fgetc(inFile);
+        pos += n;
     }
+    return pos;
+}
 
-    if(0 != count)
+/*
+* Codes data from the start with greedy steps, stopping where fewer bytes
+* than a step may need are left unless last, and returns how many bytes
+* were coded.
+*/
+static size_t RleEncodeSpan(const unsigned char* data, const size_t size, const bool last, const rle_coder_t* coder,
+    rle_stream_t* outFile)
+{
+    if(coder->optimal)
+        return RleEncodeOptimal(data, size, last, coder, outFile);
+
+    const size_t lookahead = GreedyLookahead(coder);
+    size_t pos = 0;
+    while(pos < size)
     {
-        if(count <= MAX_COPY)
+        if(!last && (size - pos < lookahead))
+            break;
+
+        size_t copyLen, runLen;
+        size_t next = GreedyStep(data, pos, size, coder, &copyLen, &runLen);
+        RleWriteCopies(data + pos, copyLen, coder, outFile);
+        if(runLen != 0)
+            RleWriteRun(data[pos + copyLen], runLen, coder, outFile);
+        pos = next;
+    }
+    return pos;
+}
+
+/* a FILE is read in blocks, the bytes a block leaves uncoded move to the front of the next */
+static void RleEncode(rle_stream_t* inFile, rle_stream_t* outFile, const rle_coder_t* coder)
+{
+    if(inFile->fp == nullptr)
+    {
+        RleEncodeSpan(inFile->buffer, inFile->size, true, coder, outFile);
+        return;
+    }
+
+    unsigned char block[PARSE_WINDOW + MAX_LOOKAHEAD + IO_BLOCK_SIZE];
+    size_t len = 0;
+    bool last = false;
+    while(!last)
+    {
+        size_t read = fread(block + len, 1, IO_BLOCK_SIZE, inFile->fp);
+        len += read;
+        last = (read == 0);
+
+        size_t coded = RleEncodeSpan(block, len, last, coder, outFile);
+        memmove(block, block + coded, len - coded);
+        len -= coded;
+    }
+}
+
+static inline void PutUint32(unsigned char* bytes, const uint32_t value)
+{
+    bytes[0] = (unsigned char)(value >> 24);
+    bytes[1] = (unsigned char)(value >> 16);
+    bytes[2] = (unsigned char)(value >> 8);
+    bytes[3] = (unsigned char)value;
+}
+
+static inline uint32_t GetUint32(const unsigned char* bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static unsigned int RowInterval(const rle_options_t* options)
+{
+    if(options->rowInterval == 0)
+        return RLE_DEFAULT_ROW_INTERVAL;
+    return options->rowInterval;
+}
+
+/*
+* Finds the width and height of an 8 bit P5 raster and the offset of its
+* first pixel: the magic, width, height and maximum value separated by
+* white space and comments, then a single white space character.
+*/
+static int ParsePgmHeader(const unsigned char* data, size_t len, unsigned int* width, unsigned int* height,
+    size_t* offset)
+{
+    if((len < 2) || (data[0] != 'P') || (data[1] != '5'))
+        return -1;
+
+    unsigned long values[3];
+    size_t i = 2;
+    for(int v = 0; v < 3; v++)
+    {
+        while(i < len)
         {
-            fputc(count - 1, outFile);
-            fwrite(charBuf, sizeof(unsigned char), count, outFile);
+            if(data[i] == '#')
+            {
+                while((i < len) && (data[i] != '\n'))
+                    i++;
+            }
+            else if((data[i] == ' ') || (data[i] == '\t') || (data[i] == '\r') || (data[i] == '\n'))
+            {
+                i++;
+            }
+            else
+            {
+                break;
+            }
         }
-        else
-        {
-            fputc(MAX_COPY - 1, outFile);
-            fwrite(charBuf, sizeof(unsigned char), MAX_COPY, outFile);
 
-            count -= MAX_COPY;
-            fputc(count - 1, outFile);
-            fwrite(&charBuf[MAX_COPY], sizeof(unsigned char), count, outFile);
+        if((i == len) || (data[i] < '0') || (data[i] > '9'))
+            return -1;
+
+        values[v] = 0;
+        while((i < len) && (data[i] >= '0') && (data[i] <= '9'))
+        {
+            if(values[v] > MAX_IMAGE_SIZE)
+                return -1;
+            values[v] = values[v] * 10 + (data[i++] - '0');
         }
     }
+
+    if((i == len) || (values[0] == 0) || (values[0] > MAX_IMAGE_SIZE) || (values[1] > MAX_IMAGE_SIZE) ||
+        (values[2] == 0) || (values[2] > UCHAR_MAX))
+        return -1;
+
+    *width = (unsigned int)values[0];
+    *height = (unsigned int)values[1];
+    *offset = i + 1;
     return 0;
 }
 
-int RleDecodeFile(FILE* inFile, FILE* outFile)
+static size_t DefaultMaxRun(const bool varint, const size_t minRun)
+{
+    return varint ? VARINT_MAX_BLOCK : minRun + CLASSIC_MAX_LENGTHS - 1;
+}
+
+static size_t DefaultMaxCopy(const bool varint)
+{
+    return varint ? VARINT_MAX_BLOCK : MAX_COPY;
+}
+
+static void InitCoder(rle_coder_t* coder, const rle_options_t* options)
+{
+    coder->varint = options->varint;
+    coder->optimal = options->optimal;
+    coder->minRun = (options->minRun != 0) ? options->minRun : MIN_RUN;
+    coder->maxRun = (options->maxRun != 0) ? options->maxRun : DefaultMaxRun(coder->varint, coder->minRun);
+    coder->maxCopy = (options->maxCopy != 0) ? options->maxCopy : DefaultMaxCopy(coder->varint);
+}
+
+static bool HasParams(const rle_coder_t* coder)
+{
+    return (coder->minRun != MIN_RUN) || (coder->maxRun != DefaultMaxRun(coder->varint, MIN_RUN)) ||
+        (coder->maxCopy != DefaultMaxCopy(coder->varint));
+}
+
+/* the classic format with classic blocks and their defaults is all there is without a header */
+static bool NeedsHeader(const RLE_FORMATS format, const rle_coder_t* coder)
+{
+    return (format != RLE_FORMAT_CLASSIC) || coder->varint || HasParams(coder);
+}
+
+static void RleWriteHeader(const RLE_FORMATS format, const rle_coder_t* coder, rle_stream_t* outFile)
+{
+    bool params = HasParams(coder);
+    RleWrite(RleSignature, RLE_SIGNATURE_SIZE, outFile);
+    RlePutChar(format | (coder->varint ? VARINT_FLAG : 0) | (params ? PARAMS_FLAG : 0), outFile);
+    if(params)
+    {
+        RlePutChar((int)coder->minRun, outFile);
+        RlePutChar((int)(coder->maxRun >> 8), outFile);
+        RlePutChar((int)(coder->maxRun & 0xFF), outFile);
+        RlePutChar((int)(coder->maxCopy >> 8), outFile);
+        RlePutChar((int)(coder->maxCopy & 0xFF), outFile);
+    }
+}
+
+/*
+* Codes data in the rows format into a buffer, every row from a fresh
+* block so the index can point at it. An image cut short keeps the rows it
+* has whole, input that is not an image has no rows and is coded as what
+* follows them.
+*/
+static void RleEncodeRows(const unsigned char* data, const size_t size, const unsigned int interval,
+    const rle_coder_t* coder, rle_stream_t* outFile)
+{
+    unsigned int width = 0;
+    unsigned int height = 0;
+    size_t offset = 0;
+    if(ParsePgmHeader(data, size, &width, &height, &offset) != 0)
+        width = height = 0;
+    else if(height > (size - offset) / width)
+        height = (unsigned int)((size - offset) / width);
+
+    unsigned char header[ROWS_HEADER_SIZE];
+    PutUint32(header, width);
+    PutUint32(header + 4, height);
+    header[8] = (unsigned char)(interval >> 8);
+    header[9] = (unsigned char)interval;
+    PutUint32(header + 10, (uint32_t)offset);
+    RleWriteHeader(RLE_FORMAT_ROWS, coder, outFile);
+    RleWrite(header, sizeof(header), outFile);
+    if(offset != 0)
+        RleWrite(data, offset, outFile);
+
+    /* the index is filled in as the rows are coded */
+    size_t groups = ((size_t)height + interval - 1) / interval;
+    unsigned char* index = nullptr;
+    if(4 * groups <= outFile->size - outFile->pos)
+    {
+        index = outFile->buffer + outFile->pos;
+        outFile->pos += 4 * groups;
+    }
+    else
+    {
+        outFile->error = 1;
+    }
+
+    const size_t start = outFile->pos;
+    const unsigned char* row = data + offset;
+    for(unsigned int y = 0; y < height; y++, row += width)
+    {
+        if((index != nullptr) && (y % interval == 0))
+            PutUint32(index + 4 * (y / interval), (uint32_t)(outFile->pos - start));
+        RleEncodeSpan(row, width, true, coder, outFile);
+    }
+    RleEncodeSpan(row, (size_t)(data + size - row), true, coder, outFile);
+}
+
+/* the rows format needs all of the input in memory, a FILE is read and coded into a buffer */
+static int RleEncodeFileRows(FILE* inFile, FILE* outFile, const rle_options_t* options)
+{
+    size_t capacity = 1 << 20;
+    unsigned char* input = new unsigned char[capacity];
+    size_t size = 0;
+    size_t len;
+    while((len = fread(input + size, 1, capacity - size, inFile)) != 0)
+    {
+        size += len;
+        if(size == capacity)
+        {
+            unsigned char* larger = new unsigned char[2 * capacity];
+            memcpy(larger, input, size);
+            delete[] input;
+            input = larger;
+            capacity *= 2;
+        }
+    }
+
+    if(ferror(inFile))
+    {
+        delete[] input;
+        return -1;
+    }
+
+    size_t bound = RleEncodeBound(size, options);
+    if(bound > UINT32_MAX)
+    {
+        delete[] input;
+        errno = EFBIG;
+        return -1;
+    }
+
+    unsigned char* coded = new unsigned char[bound];
+    rle_stream_t out;
+    rle_coder_t coder;
+    InitCoder(&coder, options);
+    InitBufferStream(&out, coded, bound);
+    RleEncodeRows(input, size, RowInterval(options), &coder, &out);
+    fwrite(coded, 1, out.pos, outFile);
+    delete[] coded;
+    delete[] input;
+    return ferror(outFile) ? -1 : 0;
+}
+
+static bool ValidOptions(const rle_options_t* options)
+{
+    if((options->format >= RLE_NO_FORMAT) || (options->rowInterval > RLE_MAX_ROW_INTERVAL))
+        return false;
+    if((options->minRun != 0) && ((options->minRun < RLE_MIN_MIN_RUN) || (options->minRun > RLE_MAX_MIN_RUN)))
+        return false;
+
+    rle_coder_t coder;
+    InitCoder(&coder, options);
+    return (coder.maxRun >= coder.minRun) && (coder.maxRun <= DefaultMaxRun(coder.varint, coder.minRun)) &&
+        (coder.maxCopy <= DefaultMaxCopy(coder.varint));
+}
+
+void RleDefaultOptions(rle_options_t* options)
+{
+    options->format = RLE_FORMAT_CLASSIC;
+    options->rowInterval = RLE_DEFAULT_ROW_INTERVAL;
+    options->varint = false;
+    options->minRun = 0;
+    options->maxRun = 0;
+    options->maxCopy = 0;
+    options->optimal = false;
+}
+
+int RleEncodeFile(FILE* inFile, FILE* outFile, const rle_options_t* options)
 {
     if((nullptr == inFile) || (nullptr == outFile))
     {
@@ -111,42 +819,699 @@ int RleDecodeFile(FILE* inFile, FILE* outFile)
         return -1;
     }
 
-    int countChar;
-    int currChar;
-    while((countChar = fgetc(inFile)) != EOF)
+    rle_options_t defaults;
+    if(options == nullptr)
+    {
+        RleDefaultOptions(&defaults);
+        options = &defaults;
+    }
+    else if(!ValidOptions(options))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(options->format == RLE_FORMAT_ROWS)
+        return RleEncodeFileRows(inFile, outFile, options);
+
+    rle_coder_t coder;
+    rle_stream_t in, out;
+    InitCoder(&coder, options);
+    InitFileStream(&in, inFile);
+    InitFileStream(&out, outFile);
+    if(NeedsHeader(RLE_FORMAT_CLASSIC, &coder))
+        RleWriteHeader(RLE_FORMAT_CLASSIC, &coder, &out);
+    RleEncode(&in, &out, &coder);
+    return 0;
+}
+
+size_t RleEncodeBound(const size_t size, const rle_options_t* options)
+{
+    /* nothing codes worse than copy blocks, one count byte per MAX_COPY */
+    if(options == nullptr)
+        return size + (size + MAX_COPY - 1) / MAX_COPY;
+    if(!ValidOptions(options))
+        return 0;
+
+    rle_coder_t coder;
+    InitCoder(&coder, options);
+
+    /*
+    * Copies of maxCopy take the most but for a copy with the shortest run
+    * after it, which costs a byte more than it saves for runs of two or a
+    * varint copy of more than VARINT_SHORT_LENGTHS. The optimal parse is
+    * never larger than the greedy one.
+    */
+    size_t control = (coder.varint && (coder.maxCopy > VARINT_SHORT_LENGTHS)) ? 2 : 1;
+    size_t bound = size + control * ((size + coder.maxCopy - 1) / coder.maxCopy);
+    if(coder.minRun < 3)
+        bound += (3 - coder.minRun) * (size / (coder.minRun + 1));
+    if((control == 2) && (coder.minRun < 4))
+        bound += (4 - coder.minRun) * (size / (VARINT_SHORT_LENGTHS + 1 + coder.minRun));
+    if(NeedsHeader(options->format, &coder))
+        bound += RLE_HEADER_SIZE + (HasParams(&coder) ? PARAMS_SIZE : 0);
+
+    /* rows of a single pixel take a control each, and every interval rows an index entry */
+    if(options->format == RLE_FORMAT_ROWS)
+        bound += ROWS_HEADER_SIZE + control * size + 4 * (size / RowInterval(options) + 1);
+    return bound;
+}
+
+int RleEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const rle_options_t* options)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    rle_options_t defaults;
+    if(options == nullptr)
+    {
+        RleDefaultOptions(&defaults);
+        options = &defaults;
+    }
+    else if(!ValidOptions(options))
     {
-        countChar = (char)countChar;
+        errno = EINVAL;
+        return -1;
+    }
 
-        if(countChar < 0)
+    rle_coder_t coder;
+    rle_stream_t in, out;
+    InitCoder(&coder, options);
+    InitBufferStream(&out, dst, capacity);
+    if(options->format == RLE_FORMAT_ROWS)
+    {
+        if(RleEncodeBound(size, options) > UINT32_MAX)
         {
-            countChar = (MIN_RUN - 1) - countChar;
-            if(EOF == (currChar = fgetc(inFile)))
+            errno = EFBIG;
+            return -1;
+        }
+        RleEncodeRows(src, size, RowInterval(options), &coder, &out);
+    }
+    else
+    {
+        if(NeedsHeader(RLE_FORMAT_CLASSIC, &coder))
+            RleWriteHeader(RLE_FORMAT_CLASSIC, &coder, &out);
+        InitBufferStream(&in, (unsigned char*)src, size);
+        RleEncode(&in, &out, &coder);
+    }
+
+    if(out.error)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    *dstSize = out.pos;
+    return 0;
+}
+
+/*
+* Decodes whole blocks of src into dst with a memset per run and a memcpy
+* per copy. While a block of any size fits on both sides nothing is
+* checked but the end of src, the last blocks are checked one by one.
+* Stops at the first block that is cut short or does not fit, the bytes
+* read and written up to it go to srcUsed and dstUsed.
+*/
+static RLE_STATUS RleDecodeSpan(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    const size_t minRun, size_t* srcUsed, size_t* dstUsed)
+{
+    const size_t maxRun = minRun + CLASSIC_MAX_LENGTHS - 1;
+    size_t in = 0;
+    size_t out = 0;
+    if((size > MAX_COPY) && (capacity >= maxRun))
+    {
+        const size_t inEnd = size - MAX_COPY;
+        const size_t outEnd = capacity - maxRun;
+        while((in < inEnd) && (out <= outEnd))
+        {
+            int count = (signed char)src[in];
+            if(count < 0)
+            {
+                count = (int)(minRun - 1) - count;
+                memset(dst + out, src[in + 1], count);
+                in += 2;
+            }
+            else
             {
-                fprintf(stderr, "Run block is too short!\n");
-                countChar = 0;
+                count++;
+                memcpy(dst + out, src + in + 1, count);
+                in += count + 1;
             }
+            out += count;
+        }
+    }
 
-            while(countChar > 0)
+    RLE_STATUS status = RLE_OK;
+    while(in < size)
+    {
+        int count = (signed char)src[in];
+        if(count < 0)
+        {
+            count = (int)(minRun - 1) - count;
+            if(size - in < 2)
             {
-                fputc(currChar, outFile);
-                countChar--;
+                status = RLE_SHORT_RUN;
+                break;
             }
+            if((size_t)count > capacity - out)
+            {
+                status = RLE_NO_ROOM;
+                break;
+            }
+            memset(dst + out, src[in + 1], count);
+            in += 2;
         }
         else
         {
-            for(countChar++; countChar > 0; countChar--)
+            count++;
+            if(size - in - 1 < (size_t)count)
             {
-                if((currChar = fgetc(inFile)) != EOF)
-                {
-                    fputc(currChar, outFile);
-                }
-                else
-                {
-                    fprintf(stderr, "Copy block is too short!\n");
-                    break;
-                }
+                status = RLE_SHORT_COPY;
+                break;
+            }
+            if((size_t)count > capacity - out)
+            {
+                status = RLE_NO_ROOM;
+                break;
+            }
+            memcpy(dst + out, src + in + 1, count);
+            in += count + 1;
+        }
+        out += count;
+    }
+
+    *srcUsed = in;
+    *dstUsed = out;
+    return status;
+}
+
+/*
+* Decodes varint blocks like RleDecodeSpan, checking every block. A control
+* of more than two bytes or a block longer than VARINT_MAX_BLOCK is
+* RLE_BAD_LENGTH.
+*/
+static RLE_STATUS RleDecodeVarintSpan(const unsigned char* src, const size_t size, unsigned char* dst,
+    const size_t capacity, const size_t minRun, size_t* srcUsed, size_t* dstUsed)
+{
+    size_t in = 0;
+    size_t out = 0;
+    RLE_STATUS status = RLE_OK;
+    while(in < size)
+    {
+        size_t control = src[in];
+        size_t head = 1;
+        if(control & 0x80)
+        {
+            if(size - in < 2)
+            {
+                status = (control & 1) ? RLE_SHORT_RUN : RLE_SHORT_COPY;
+                break;
             }
+            if(src[in + 1] & 0x80)
+            {
+                status = RLE_BAD_LENGTH;
+                break;
+            }
+            control = (control & 0x7F) | ((size_t)src[in + 1] << 7);
+            head = 2;
+        }
+
+        size_t count = control >> 1;
+        if(control & 1)
+        {
+            count += minRun;
+            if(count > VARINT_MAX_BLOCK)
+            {
+                status = RLE_BAD_LENGTH;
+                break;
+            }
+            if(size - in - head < 1)
+            {
+                status = RLE_SHORT_RUN;
+                break;
+            }
+            if(count > capacity - out)
+            {
+                status = RLE_NO_ROOM;
+                break;
+            }
+            memset(dst + out, src[in + head], count);
+            in += head + 1;
+        }
+        else
+        {
+            count++;
+            if(size - in - head < count)
+            {
+                status = RLE_SHORT_COPY;
+                break;
+            }
+            if(count > capacity - out)
+            {
+                status = RLE_NO_ROOM;
+                break;
+            }
+            memcpy(dst + out, src + in + head, count);
+            in += head + count;
+        }
+        out += count;
+    }
+
+    *srcUsed = in;
+    *dstUsed = out;
+    return status;
+}
+
+static rle_span_decoder_t HeaderDecoder(const rle_header_t* header)
+{
+    return header->varint ? RleDecodeVarintSpan : RleDecodeSpan;
+}
+
+/* writes out what of a block of output is past skip bytes */
+static void RleFlush(const unsigned char* block, const size_t len, size_t* skip, FILE* outFile)
+{
+    if(*skip >= len)
+    {
+        *skip -= len;
+        return;
+    }
+
+    fwrite(block + *skip, 1, len - *skip, outFile);
+    *skip = 0;
+}
+
+/*
+* The coded FILE is read in blocks into memory and decoded into a block of
+* output, which is written out whenever the next run or copy does not fit.
+* A coded block cut by the end of what was read moves to the front for the
+* next read. A classic copy cut short by the end of the FILE still writes
+* the bytes it has. The start bytes were read ahead of the FILE. Decoding
+* stops after skip and limit bytes, the first skip of them are not written.
+*/
+static RLE_STATUS RleDecodeStream(FILE* inFile, FILE* outFile, const rle_header_t* header,
+    const unsigned char* start, const size_t startLen, size_t skip, const size_t limit)
+{
+    rle_span_decoder_t decode = HeaderDecoder(header);
+    unsigned char inBlock[MAX_BLOCK_BYTES + IO_BLOCK_SIZE];
+    unsigned char outBlock[IO_BLOCK_SIZE];
+    if(startLen != 0)
+        memcpy(inBlock, start, startLen);
+    size_t len = startLen;
+    size_t outLen = 0;
+    size_t left = (limit > SIZE_MAX - skip) ? SIZE_MAX : skip + limit;
+    RLE_STATUS status = RLE_OK;
+    bool last = false;
+    while(!last && (left != 0))
+    {
+        size_t read = fread(inBlock + len, 1, IO_BLOCK_SIZE, inFile);
+        len += read;
+        last = (read == 0);
+
+        size_t pos = 0;
+        while(true)
+        {
+            size_t room = IO_BLOCK_SIZE - outLen;
+            bool limited = (room >= left);
+            if(limited)
+                room = left;
+
+            size_t srcUsed, dstUsed;
+            status = decode(inBlock + pos, len - pos, outBlock + outLen, room, header->minRun, &srcUsed, &dstUsed);
+            pos += srcUsed;
+            outLen += dstUsed;
+            left -= dstUsed;
+            if(left == 0)
+                status = RLE_OK;
+            if((status != RLE_NO_ROOM) || limited)
+                break;
+
+            RleFlush(outBlock, outLen, &skip, outFile);
+            outLen = 0;
+        }
+
+        if((status == RLE_NO_ROOM) || (status == RLE_BAD_LENGTH))
+            break;
+
+        if(last && (status == RLE_SHORT_COPY) && (decode == RleDecodeSpan))
+        {
+            RleFlush(outBlock, outLen, &skip, outFile);
+            outLen = len - pos - 1;
+            if(outLen > left)
+                outLen = left;
+            memcpy(outBlock, inBlock + pos + 1, outLen);
+        }
+
+        memmove(inBlock, inBlock + pos, len - pos);
+        len -= pos;
+    }
+
+    RleFlush(outBlock, outLen, &skip, outFile);
+    if((status == RLE_OK) && (limit != SIZE_MAX) && (left != 0))
+        status = RLE_SHORT_ROWS;
+    return status;
+}
+
+static bool HasSignature(const unsigned char* bytes, const size_t len)
+{
+    return (len >= RLE_HEADER_SIZE) && (memcmp(bytes, RleSignature, RLE_SIGNATURE_SIZE) == 0);
+}
+
+static void InitClassicHeader(rle_header_t* header)
+{
+    header->format = RLE_FORMAT_CLASSIC;
+    header->varint = false;
+    header->minRun = MIN_RUN;
+    header->maxRun = MAX_RUN;
+    header->maxCopy = MAX_COPY;
+    header->width = header->height = 0;
+    header->interval = 1;
+    header->headerLen = header->groups = 0;
+}
+
+/*
+* Reads the header of a stream that has the signature, len bytes of it are
+* in bytes. Returns how many bytes the header takes up to the PGM header of
+* the rows format, more than len when they are not all there, and -1 when
+* it is damaged.
+*/
+static int ParseRleHeader(const unsigned char* bytes, const size_t len, rle_header_t* header)
+{
+    InitClassicHeader(header);
+    const int format = bytes[RLE_SIGNATURE_SIZE] & ~(VARINT_FLAG | PARAMS_FLAG);
+    const bool params = (bytes[RLE_SIGNATURE_SIZE] & PARAMS_FLAG) != 0;
+    header->varint = (bytes[RLE_SIGNATURE_SIZE] & VARINT_FLAG) != 0;
+    if((format != RLE_FORMAT_CLASSIC) && (format != RLE_FORMAT_ROWS))
+        return -1;
+
+    header->format = (RLE_FORMATS)format;
+    const int size = RLE_HEADER_SIZE + (params ? PARAMS_SIZE : 0) +
+        ((format == RLE_FORMAT_ROWS) ? ROWS_HEADER_SIZE : 0);
+    if(len < (size_t)size)
+        return size;
+
+    bytes += RLE_HEADER_SIZE;
+    header->maxRun = (unsigned int)DefaultMaxRun(header->varint, MIN_RUN);
+    header->maxCopy = (unsigned int)DefaultMaxCopy(header->varint);
+    if(params)
+    {
+        header->minRun = bytes[0];
+        header->maxRun = ((unsigned int)bytes[1] << 8) | bytes[2];
+        header->maxCopy = ((unsigned int)bytes[3] << 8) | bytes[4];
+        if((header->minRun < RLE_MIN_MIN_RUN) || (header->minRun > RLE_MAX_MIN_RUN) ||
+            (header->maxRun < header->minRun) || (header->maxRun > DefaultMaxRun(header->varint, header->minRun)) ||
+            (header->maxCopy == 0) || (header->maxCopy > DefaultMaxCopy(header->varint)))
+            return -1;
+        bytes += PARAMS_SIZE;
+    }
+
+    if(format == RLE_FORMAT_ROWS)
+    {
+        header->width = GetUint32(bytes);
+        header->height = GetUint32(bytes + 4);
+        header->interval = ((unsigned int)bytes[8] << 8) | bytes[9];
+        header->headerLen = GetUint32(bytes + 10);
+        if((header->interval == 0) || ((header->width == 0) && (header->height != 0)))
+            return -1;
+        header->groups = ((size_t)header->height + header->interval - 1) / header->interval;
+    }
+    return size;
+}
+
+/*
+* Reads the header of a FILE, a classic stream without one has the bytes
+* read for it left in start. -1 with errno EILSEQ for a damaged header.
+*/
+static int RleReadHeader(FILE* inFile, unsigned char* start, size_t* startLen, rle_header_t* header)
+{
+    *startLen = fread(start, 1, RLE_HEADER_SIZE, inFile);
+    if(!HasSignature(start, *startLen))
+    {
+        InitClassicHeader(header);
+        return 0;
+    }
+
+    int used = ParseRleHeader(start, *startLen, header);
+    if(used > RLE_HEADER_SIZE)
+    {
+        *startLen += fread(start + RLE_HEADER_SIZE, 1, used - RLE_HEADER_SIZE, inFile);
+        used = ParseRleHeader(start, *startLen, header);
+    }
+
+    if((used < 0) || ((size_t)used > *startLen))
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+    *startLen = 0;
+    return 0;
+}
+
+/* moves count bytes on in a FILE, reading them when it can not seek, -1 when the FILE ends first */
+static int RleSkipInput(FILE* inFile, uint64_t count)
+{
+    if((count <= LONG_MAX) && (fseek(inFile, (long)count, SEEK_CUR) == 0))
+        return 0;
+
+    unsigned char block[IO_BLOCK_SIZE];
+    while(count != 0)
+    {
+        size_t len = (count < IO_BLOCK_SIZE) ? (size_t)count : IO_BLOCK_SIZE;
+        if(fread(block, 1, len, inFile) != len)
+            return -1;
+        count -= len;
+    }
+    return 0;
+}
+
+/* copies the PGM header of a rows stream as it is and moves past the index */
+static int RleCopyRowsHeader(FILE* inFile, FILE* outFile, const rle_header_t* header)
+{
+    unsigned char block[IO_BLOCK_SIZE];
+    size_t left = header->headerLen;
+    while(left != 0)
+    {
+        size_t len = (left < IO_BLOCK_SIZE) ? left : IO_BLOCK_SIZE;
+        if(fread(block, 1, len, inFile) != len)
+            return -1;
+        fwrite(block, 1, len, outFile);
+        left -= len;
+    }
+    return RleSkipInput(inFile, 4 * (uint64_t)header->groups);
+}
+
+int RleDecodeFile(FILE* inFile, FILE* outFile)
+{
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    unsigned char start[MAX_HEADER_SIZE];
+    size_t startLen;
+    rle_header_t header;
+    if(RleReadHeader(inFile, start, &startLen, &header) != 0)
+        return -1;
+    if((header.format == RLE_FORMAT_ROWS) && (RleCopyRowsHeader(inFile, outFile, &header) != 0))
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+
+    switch(RleDecodeStream(inFile, outFile, &header, start, startLen, 0, SIZE_MAX))
+    {
+    case RLE_SHORT_RUN:
+        fprintf(stderr, "Run block is too short!\n");
+        break;
+    case RLE_SHORT_COPY:
+        fprintf(stderr, "Copy block is too short!\n");
+        break;
+    case RLE_BAD_LENGTH:
+        fprintf(stderr, "Block length is out of range!\n");
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/*
+* Checks the header in src and finds where the index of the rows format
+* and the coded data start, a classic stream without a header has them at
+* 0. -1 with errno EILSEQ for a damaged header.
+*/
+static int RleFindData(const unsigned char* src, const size_t size, rle_header_t* header, size_t* index,
+    size_t* data)
+{
+    *index = *data = 0;
+    if(!HasSignature(src, size))
+    {
+        InitClassicHeader(header);
+        return 0;
+    }
+
+    int used = ParseRleHeader(src, size, header);
+    if((used < 0) || ((size_t)used > size) || (header->headerLen > size - (size_t)used) ||
+        (header->groups > (size - (size_t)used - header->headerLen) / 4))
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+
+    *index = used + header->headerLen;
+    *data = *index + 4 * header->groups;
+    return 0;
+}
+
+int RleDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    rle_header_t header;
+    size_t index, pos;
+    if(RleFindData(src, size, &header, &index, &pos) != 0)
+        return -1;
+    if(header.headerLen > capacity)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+    if(header.headerLen != 0)
+        memcpy(dst, src + index - header.headerLen, header.headerLen);
+    size_t written = header.headerLen;
+
+    size_t srcUsed, dstUsed;
+    RLE_STATUS status = HeaderDecoder(&header)(src + pos, size - pos, dst + written, capacity - written,
+        header.minRun, &srcUsed, &dstUsed);
+    if(status == RLE_NO_ROOM)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+    else if(status != RLE_OK)
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+
+    *dstSize = written + dstUsed;
+    return 0;
+}
+
+static bool ValidRows(const rle_header_t* header, const unsigned int firstRow, const unsigned int numRows)
+{
+    return (firstRow <= header->height) && (numRows <= header->height - firstRow);
+}
+
+int RleDecodeRows(FILE* inFile, FILE* outFile, const unsigned int firstRow, const unsigned int numRows)
+{
+    if((nullptr == inFile) || (nullptr == outFile))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    unsigned char start[MAX_HEADER_SIZE];
+    size_t startLen;
+    rle_header_t header;
+    if(RleReadHeader(inFile, start, &startLen, &header) != 0)
+        return -1;
+    if((header.format != RLE_FORMAT_ROWS) || !ValidRows(&header, firstRow, numRows))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(numRows == 0)
+        return 0;
+
+    /* the index entry of the group firstRow is in, then the data from where the group starts */
+    size_t group = firstRow / header.interval;
+    unsigned char entry[4];
+    if((RleSkipInput(inFile, header.headerLen + 4 * (uint64_t)group) != 0) || (fread(entry, 1, 4, inFile) != 4) ||
+        (RleSkipInput(inFile, 4 * (uint64_t)(header.groups - group - 1) + GetUint32(entry)) != 0))
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+
+    size_t skip = (size_t)(firstRow - group * header.interval) * header.width;
+    if(RleDecodeStream(inFile, outFile, &header, nullptr, 0, skip,
+        (size_t)numRows * header.width) != RLE_OK)
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+    return 0;
+}
+
+int RleDecodeBufferRows(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const unsigned int firstRow, const unsigned int numRows)
+{
+    if(((nullptr == src) && (size != 0)) || ((nullptr == dst) && (capacity != 0)) || (nullptr == dstSize))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    rle_header_t header;
+    size_t index, data;
+    if(RleFindData(src, size, &header, &index, &data) != 0)
+        return -1;
+    if((header.format != RLE_FORMAT_ROWS) || !ValidRows(&header, firstRow, numRows))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t rowsSize = (size_t)numRows * header.width;
+    if(rowsSize > capacity)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+    *dstSize = 0;
+    if(numRows == 0)
+        return 0;
+
+    size_t group = firstRow / header.interval;
+    size_t pos = GetUint32(src + index + 4 * group);
+    if(pos > size - data)
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+    pos += data;
+
+    /* rows before firstRow are decoded into dst one at a time and dropped */
+    rle_span_decoder_t decode = HeaderDecoder(&header);
+    size_t srcUsed, dstUsed;
+    for(size_t y = group * header.interval; y < firstRow; y++)
+    {
+        decode(src + pos, size - pos, dst, header.width, header.minRun, &srcUsed, &dstUsed);
+        if(dstUsed != header.width)
+        {
+            errno = EILSEQ;
+            return -1;
         }
+        pos += srcUsed;
     }
+
+    decode(src + pos, size - pos, dst, rowsSize, header.minRun, &srcUsed, &dstUsed);
+    if(dstUsed != rowsSize)
+    {
+        errno = EILSEQ;
+        return -1;
+    }
+
+    *dstSize = rowsSize;
     return 0;
 }
@@ -1,7 +1,66 @@
 #ifndef _RLE_H_
 #define _RLE_H_
 
-int RleEncodeFile(FILE* inFile, FILE* outFile);
+typedef enum
+{
+    RLE_FORMAT_CLASSIC = 0, /* count and bytes blocks with no header, the default */
+    RLE_FORMAT_ROWS,        /* every row of an 8 bit PGM coded on its own, with an index of where rows start */
+    RLE_NO_FORMAT
+} RLE_FORMATS;
+
+/* rows between entries of the RLE_FORMAT_ROWS index */
+#define RLE_DEFAULT_ROW_INTERVAL    16
+#define RLE_MAX_ROW_INTERVAL        65535
+
+/*
+* Block settings, 0 takes the default of the blocks. Classic blocks take
+* runs of 3 to 130 and copies of up to 128, a count byte holds at most 128
+* lengths of either. Varint blocks take runs from 3 and both up to 8192.
+* Settings other than the defaults are kept in the stream header.
+*/
+#define RLE_MIN_MIN_RUN             2
+#define RLE_MAX_MIN_RUN             16
+
+typedef struct rle_options_t
+{
+    RLE_FORMATS format;
+    unsigned int rowInterval;   /* 0 for RLE_DEFAULT_ROW_INTERVAL */
+    bool varint;                /* blocks of up to 8192 bytes with varint lengths instead of PackBits counts */
+    unsigned int minRun;        /* shortest run coded as a run */
+    unsigned int maxRun;
+    unsigned int maxCopy;
+    bool optimal;               /* the fewest bytes for up to 16 KB at a time, never more than greedy blocks, slower */
+} rle_options_t;
+
+void RleDefaultOptions(rle_options_t* options);
+
+/*
+* Options may be nullptr for the classic format. Decoding finds the format
+* from the stream. Input for RLE_FORMAT_ROWS that is not an 8 bit P5 image
+* is coded without rows, so none can be decoded on their own.
+*/
+int RleEncodeFile(FILE* inFile, FILE* outFile, const rle_options_t* options = nullptr);
 int RleDecodeFile(FILE* inFile, FILE* outFile);
 
+/*
+* The same coding between buffers, without stdio or allocation. The bytes
+* written go to dstSize, when they do not fit in capacity -1 is returned with
+* errno ENOSPC. RleEncodeBound is enough capacity for any input of size bytes.
+*/
+size_t RleEncodeBound(const size_t size, const rle_options_t* options = nullptr);
+int RleEncodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const rle_options_t* options = nullptr);
+int RleDecodeBuffer(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize);
+
+/*
+* Decodes numRows rows from firstRow on of a RLE_FORMAT_ROWS stream, just
+* the pixels, starting from the nearest indexed row before firstRow. -1
+* with errno EINVAL for another format or rows past the image, EILSEQ for
+* a damaged stream.
+*/
+int RleDecodeRows(FILE* inFile, FILE* outFile, const unsigned int firstRow, const unsigned int numRows);
+int RleDecodeBufferRows(const unsigned char* src, const size_t size, unsigned char* dst, const size_t capacity,
+    size_t* dstSize, const unsigned int firstRow, const unsigned int numRows);
+
 #endif
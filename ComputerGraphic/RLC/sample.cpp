@@ -1,25 +1,57 @@
 #include "pch.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include "rle.h"
 #include <experimental/filesystem>
 
 void main(int argc, const char* argv[])
 {
-    if(argc == 0)
+    if(argc < 2)
         return;
 
-    std::experimental::filesystem::path filePath = argv[1];
+    rle_options_t options;
+    RleDefaultOptions(&options);
+    bool rows = false;
+    unsigned int firstRow = 0;
+    unsigned int numRows = 0;
+    for(int i = 1; i < argc - 1; i++)
+    {
+        if(strcmp(argv[i], "-r") == 0)
+            options.format = RLE_FORMAT_ROWS;
+        else if(strcmp(argv[i], "-v") == 0)
+            options.varint = true;
+        else if(strcmp(argv[i], "-o") == 0)
+            options.optimal = true;
+        else if((strcmp(argv[i], "-i") == 0) && (i + 1 < argc - 1))
+            options.rowInterval = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-m") == 0) && (i + 1 < argc - 1))
+            options.minRun = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-mr") == 0) && (i + 1 < argc - 1))
+            options.maxRun = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-mc") == 0) && (i + 1 < argc - 1))
+            options.maxCopy = atoi(argv[++i]);
+        else if((strcmp(argv[i], "-rows") == 0) && (i + 2 < argc - 1))
+        {
+            rows = true;
+            firstRow = atoi(argv[++i]);
+            numRows = atoi(argv[++i]);
+        }
+    }
+
+    std::experimental::filesystem::path filePath = argv[argc - 1];
     std::string ext = filePath.extension().string();
 
-    if(ext.compare(".Huffman") == 0 || ext.compare(".Arc") == 0)
+    if(ext.compare(".Huffman") == 0 || ext.compare(".Arc") == 0 || ext.compare(".Ans") == 0 || ext.compare(".dic") == 0)
         return;
 
     bool encode = ext.compare(".Rlc") != 0;
     FILE* inFile = fopen(filePath.string().c_str(), "rb");
     if(encode)
         filePath.replace_extension(".Rlc");
+    else if(rows)
+        filePath.replace_extension("_rowsRlc.raw");
     else
         filePath.replace_extension("_decRlc.pgm");
     FILE* outFile = fopen(filePath.string().c_str(), "wb");
@@ -37,7 +69,16 @@ void main(int argc, const char* argv[])
     }
 
     if(encode)
-        RleEncodeFile(inFile, outFile);
+    {
+        if(RleEncodeFile(inFile, outFile, &options) != 0)
+            fprintf(stderr, "error: can not encode: %s\n", strerror(errno));
+    }
+    else if(rows)
+    {
+        if(RleDecodeRows(inFile, outFile, firstRow, numRows) != 0)
+            fprintf(stderr, "error: rows %u to %u can not be decoded: %s\n", firstRow, firstRow + numRows,
+                strerror(errno));
+    }
     else
         RleDecodeFile(inFile, outFile);
 
@@ -0,0 +1,53 @@
+import os
+import subprocess
+
+# a range coded stream cut short must fail to decode, not write output until the disk is full
+directory = "truncated"
+if not os.path.isdir(directory):
+    os.mkdir(directory)
+
+data = b""
+for name in os.listdir("gray8bit"):
+    filename, file_extension = os.path.splitext(name)
+    if(file_extension == ".pgm"):
+        with open("gray8bit\\" + name, "rb") as f:
+            data = f.read()[:9000]
+        break
+
+# the option of each format and the format byte of its header
+formats = {"-r": 1, "-s": 2, "-i": 3, "-d": 4, "-m": 5, "-e": 6}
+
+failures = 0
+for option in formats:
+    filename = directory + "\\format" + str(formats[option])
+    with open(filename + ".pgm", "wb") as f:
+        f.write(data)
+    subprocess.call(["ComputerGraphic\\x64\\Release\\ArithmeticСoding.exe", option, filename + ".pgm"])
+    with open(filename + ".Arc", "rb") as f:
+        coded = f.read()
+
+    cuts = [bytes([0xFF, 0xFF, formats[option]])]
+    cuts += [coded[:size] for size in range(4, len(coded), 97)]
+    cuts += [coded[:len(coded) - size] for size in range(1, 6)]
+    for cut in cuts:
+        with open(filename + "cut.Arc", "wb") as f:
+            f.write(cut)
+
+        stopped = True
+        try:
+            subprocess.call(["ComputerGraphic\\x64\\Release\\ArithmeticСoding.exe", filename + "cut.Arc"], timeout=10)
+        except subprocess.TimeoutExpired:
+            stopped = False
+
+        decodedSize = 0
+        for name in os.listdir(directory):
+            if name.startswith("format" + str(formats[option]) + "cut.") and "_decArc" in name:
+                decodedSize = os.path.getsize(directory + "\\" + name)
+                os.remove(directory + "\\" + name)
+
+        if not stopped or decodedSize > len(data):
+            failures += 1
+            print(option + " cut to " + str(len(cut)) + " bytes: decoded " + str(decodedSize) + " bytes"
+                + ("" if stopped else ", does not stop"))
+
+print(str(failures) + " failures")
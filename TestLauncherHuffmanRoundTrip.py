@@ -0,0 +1,38 @@
+import os
+import random
+import subprocess
+
+# every input of 1 to 8 bytes is coded with every stream count, with and without blocks, and must decode unchanged
+directory = "roundtrip"
+if not os.path.isdir(directory):
+    os.mkdir(directory)
+
+random.seed(1)
+inputs = [bytes([0xe5, 0x1d])]
+for size in range(1, 9):
+    for alphabet in [1, 2, 4, 256]:
+        for i in range(4):
+            inputs.append(bytes(random.randrange(alphabet) for j in range(size)))
+
+failures = 0
+for streams in range(1, 17):
+    for block in [[], ["-b", "4096"]]:
+        for i in range(len(inputs)):
+            filename = directory + "\\small" + str(i)
+            with open(filename + ".bin", "wb") as f:
+                f.write(inputs[i])
+            options = ["-s", str(streams)] + block
+            subprocess.call(["ComputerGraphic\\x64\\Release\\Huffman.exe"] + options + [filename + ".bin"])
+            subprocess.call(["ComputerGraphic\\x64\\Release\\Huffman.exe"] + options + [filename + ".Huffman"])
+
+            decoded = b""
+            for name in os.listdir(directory):
+                if name.startswith("small" + str(i) + ".") and "_decHuffman" in name:
+                    with open(directory + "\\" + name, "rb") as f:
+                        decoded = f.read()
+                    os.remove(directory + "\\" + name)
+            if decoded != inputs[i]:
+                failures += 1
+                print("round trip failed: " + inputs[i].hex() + " " + " ".join(options))
+
+print(str(failures) + " failures")
@@ -0,0 +1,58 @@
+import os
+import random
+import subprocess
+
+# the optimal parse must never code larger than the greedy one with the same settings, and must decode unchanged
+directory = "rleoptimal"
+if not os.path.isdir(directory):
+    os.mkdir(directory)
+
+inputs = {}
+for name in os.listdir("gray8bit"):
+    filename, file_extension = os.path.splitext(name)
+    if(file_extension == ".pgm"):
+        with open("gray8bit\\" + name, "rb") as f:
+            inputs[filename] = f.read()
+
+inputs["zero"] = bytes(300000)
+fib, previous = b"a", b"b"
+while len(fib) < 40000:
+    fib, previous = fib + previous, fib
+inputs["fib"] = fib[:40000]
+random.seed(1)
+mix = bytearray()
+while len(mix) < 1500000:
+    if random.random() < 0.5:
+        mix += bytes([random.randrange(256)]) * random.randrange(1, 300)
+    else:
+        mix += bytes(random.randrange(256) for i in range(random.randrange(1, 400)))
+inputs["mix"] = bytes(mix)
+
+settings = [[], ["-r"], ["-v"], ["-m", "2"], ["-m", "5"], ["-v", "-m", "2"], ["-mc", "3"], ["-m", "16", "-mc", "1"]]
+
+failures = 0
+for name in inputs:
+    filename = directory + "\\" + name
+    with open(filename + ".pgm", "wb") as f:
+        f.write(inputs[name])
+
+    for options in settings:
+        sizes = []
+        for optimal in [[], ["-o"]]:
+            subprocess.call(["ComputerGraphic\\x64\\Release\\RLC.exe"] + options + optimal + [filename + ".pgm"])
+            sizes.append(os.path.getsize(filename + ".Rlc"))
+
+        subprocess.call(["ComputerGraphic\\x64\\Release\\RLC.exe", filename + ".Rlc"])
+        decoded = b""
+        for decodedName in os.listdir(directory):
+            if decodedName.startswith(name + ".") and "_decRlc" in decodedName:
+                with open(directory + "\\" + decodedName, "rb") as f:
+                    decoded = f.read()
+                os.remove(directory + "\\" + decodedName)
+
+        if sizes[1] > sizes[0] or decoded != inputs[name]:
+            failures += 1
+            print(name + " " + " ".join(options) + ": greedy " + str(sizes[0]) + ", optimal " + str(sizes[1])
+                + ("" if decoded == inputs[name] else ", does not decode"))
+
+print(str(failures) + " failures")